@@ -0,0 +1,569 @@
+#!/usr/bin/env python3
+"""
+Compiles a clipping stage netlist into a circuit header for TSClippingStage.
+
+The netlist is solved with modified nodal analysis in exact rational
+arithmetic, taking the capacitor voltages as the states, to get the
+continuous time model
+
+    dx/dt = A x + B u + C i
+    y     = D x + E u + F i
+    v     = G x
+
+where u is the input, i the current through the diode pair and v the voltage
+across it. Distortion moves one resistor, which must move exactly one entry
+of A; TSClippingStage tabulates the discretised arrays over distortion and
+relies on that.
+
+The trapezoidal discretisation is then expanded symbolically in 2 fs and the
+distortion dependent entry of A, with every coefficient folded to a constant
+and the common factors of ratios cancelled.
+Terms that are zero for every rate and distortion are dropped, both from the
+generated discretise() and, through the masks the header exposes, from the
+per-sample state update.
+
+Netlist lines, with SPICE value suffixes (f p n u m k meg g):
+
+    .name TS808                 name of the generated struct, TS808Circuit
+    .description text           comment for the generated header
+    .output out                 output node
+    Vin in 0                    the input, a voltage source from node to node
+    R1 p 0 10k                  resistor
+    RV2 out n 51k 500k          distortion resistor, 51k + distortion * 500k
+    C1 in p 1u                  capacitor, a state: v(in) - v(p)
+    U1 p n out                  ideal op-amp: +, -, output
+    D1 out n                    the diode pair, current flowing from out to n
+
+Node 0 is ground; # starts a comment.
+
+Usage:
+    circuit_compiler.py Tools/Circuits/TS808.cir -o TubeScreamer/Source/TS808Circuit.h
+"""
+
+import argparse
+import os
+import re
+import sys
+from decimal import Decimal
+from fractions import Fraction
+
+SUFFIXES = [("meg", Fraction(10) ** 6), ("f", Fraction(1, 10 ** 15)), ("p", Fraction(1, 10 ** 12)),
+            ("n", Fraction(1, 10 ** 9)), ("u", Fraction(1, 10 ** 6)), ("m", Fraction(1, 10 ** 3)),
+            ("k", Fraction(10) ** 3), ("g", Fraction(10) ** 9)]
+
+
+class NetlistError(Exception):
+    pass
+
+
+def parse_value(text):
+    """SPICE value, e.g. 4.7k or 51p, as an exact fraction"""
+    match = re.fullmatch(r"([-+]?[0-9.]+(?:e[-+]?[0-9]+)?)([a-z]*)", text.lower())
+    if match is None:
+        raise NetlistError("bad value: " + text)
+
+    value = Fraction(Decimal(match.group(1)))
+    suffix = match.group(2)
+    for name, scale in SUFFIXES:
+        if suffix.startswith(name):
+            return value * scale
+
+    if suffix:
+        raise NetlistError("bad value suffix: " + text)
+    return value
+
+
+class Netlist:
+    def __init__(self, path):
+        self.name = None
+        self.description = ""
+        self.output = None
+        self.input = None
+        self.resistors = []
+        self.pot = None
+        self.capacitors = []
+        self.opamps = []
+        self.diode = None
+        self.lines = []
+
+        with open(path) as f:
+            for number, raw in enumerate(f, 1):
+                line = raw.split("#", 1)[0].strip()
+                if not line:
+                    continue
+                try:
+                    self.parse_line(line)
+                except (NetlistError, IndexError) as e:
+                    raise NetlistError("{}:{}: {}".format(path, number, e if str(e) else "missing field"))
+                self.lines.append(line)
+
+        if self.name is None:
+            self.name = os.path.splitext(os.path.basename(path))[0]
+        for what, value in (("an input", self.input), ("an .output", self.output),
+                            ("a distortion resistor", self.pot), ("a diode pair", self.diode)):
+            if value is None:
+                raise NetlistError("{}: needs {}".format(path, what))
+        if len(self.capacitors) != 3:
+            raise NetlistError("{}: TSClippingStage needs exactly 3 capacitors, found {}".format(path, len(self.capacitors)))
+
+    def parse_line(self, line):
+        fields = line.split()
+        kind = fields[0].lower()
+
+        if kind == ".name":
+            self.name = fields[1]
+        elif kind == ".description":
+            self.description = line.split(None, 1)[1]
+        elif kind == ".output":
+            self.output = fields[1]
+        elif kind.startswith("."):
+            raise NetlistError("unknown directive " + fields[0])
+        elif kind.startswith("rv"):
+            if self.pot is not None:
+                raise NetlistError("only one distortion resistor is supported")
+            self.pot = (fields[0], fields[1], fields[2], parse_value(fields[3]), parse_value(fields[4]))
+        elif kind.startswith("r"):
+            self.resistors.append((fields[0], fields[1], fields[2], parse_value(fields[3])))
+        elif kind.startswith("c"):
+            self.capacitors.append((fields[0], fields[1], fields[2], parse_value(fields[3])))
+        elif kind.startswith("v"):
+            if self.input is not None:
+                raise NetlistError("only one input is supported")
+            self.input = (fields[0], fields[1], fields[2])
+        elif kind.startswith("u"):
+            self.opamps.append((fields[0], fields[1], fields[2], fields[3]))
+        elif kind.startswith("d"):
+            if self.diode is not None:
+                raise NetlistError("only one diode pair is supported")
+            self.diode = (fields[0], fields[1], fields[2])
+        else:
+            raise NetlistError("unknown element " + fields[0])
+
+    def nodes(self):
+        names = []
+        elements = [r[1:3] for r in self.resistors] + [self.pot[1:3]] + [c[1:3] for c in self.capacitors]
+        elements += [self.input[1:3], self.diode[1:3]] + [o[1:4] for o in self.opamps] + [(self.output,)]
+        for element in elements:
+            for node in element:
+                if node != "0" and node not in names:
+                    names.append(node)
+        return names
+
+
+def solve(matrix, rhs):
+    """Exact Gaussian elimination"""
+    n = len(matrix)
+    m = [row[:] + [b] for row, b in zip(matrix, rhs)]
+    for col in range(n):
+        pivot = next((r for r in range(col, n) if m[r][col] != 0), None)
+        if pivot is None:
+            raise NetlistError("the circuit has no unique solution; check for floating nodes or loops of sources")
+        m[col], m[pivot] = m[pivot], m[col]
+        for r in range(n):
+            if r != col and m[r][col] != 0:
+                factor = m[r][col] / m[col][col]
+                m[r] = [a - factor * b for a, b in zip(m[r], m[col])]
+    return [m[r][n] / m[r][r] for r in range(n)]
+
+
+def state_space(net, pot_conductance):
+    """Continuous time arrays A, B, C, D, E, F, G and the feedthrough of v, at a conductance of the distortion resistor"""
+    nodes = net.nodes()
+    index = {node: k for k, node in enumerate(nodes)}
+    sources = [net.input] + net.capacitors          # voltage sources: input, then the states
+    size = len(nodes) + len(sources) + len(net.opamps)
+
+    matrix = [[Fraction(0)] * size for _ in range(size)]
+
+    def stamp(row, col, value):
+        if row in index and col in index:
+            matrix[index[row]][index[col]] += value
+
+    resistors = [(r[1], r[2], 1 / r[3]) for r in net.resistors] + [(net.pot[1], net.pot[2], pot_conductance)]
+    for a, b, g in resistors:
+        stamp(a, a, g)
+        stamp(b, b, g)
+        stamp(a, b, -g)
+        stamp(b, a, -g)
+
+    # source k carries current j from its first node to its second and fixes their difference
+    for k, source in enumerate(sources):
+        row = len(nodes) + k
+        for node, sign in ((source[1], 1), (source[2], -1)):
+            if node in index:
+                matrix[index[node]][row] += sign
+                matrix[row][index[node]] += sign
+
+    # op-amp output current is free; the inputs are held equal
+    for k, (_, plus, minus, out) in enumerate(net.opamps):
+        row = len(nodes) + len(sources) + k
+        if out in index:
+            matrix[index[out]][row] -= 1
+        for node, sign in ((plus, 1), (minus, -1)):
+            if node in index:
+                matrix[row][index[node]] += sign
+
+    def response(u, x, i):
+        rhs = [Fraction(0)] * size
+        rhs[len(nodes)] = u
+        for k, value in enumerate(x):
+            rhs[len(nodes) + 1 + k] = value
+        for node, sign in ((net.diode[1], -1), (net.diode[2], 1)):
+            if node in index:
+                rhs[index[node]] += sign * i
+
+        v = solve(matrix, rhs)
+        voltage = lambda node: v[index[node]] if node in index else Fraction(0)
+        derivatives = [v[len(nodes) + 1 + k] / c[3] for k, c in enumerate(net.capacitors)]
+        return derivatives, voltage(net.output), voltage(net.diode[1]) - voltage(net.diode[2])
+
+    zero = [Fraction(0)] * 3
+    columns = [response(Fraction(0), [Fraction(int(k == j)) for k in range(3)], Fraction(0)) for j in range(3)]
+    input_response = response(Fraction(1), zero, Fraction(0))
+    current_response = response(Fraction(0), zero, Fraction(1))
+
+    return {
+        "A": [[columns[j][0][i] for j in range(3)] for i in range(3)],
+        "B": input_response[0],
+        "C": current_response[0],
+        "D": [columns[j][1] for j in range(3)],
+        "E": input_response[1],
+        "F": current_response[1],
+        "G": [columns[j][2] for j in range(3)],
+        "vFeedthrough": (input_response[2], current_response[2]),
+    }
+
+
+# Polynomials in c = 2 fs and a, the distortion dependent entry of A, as {(power of c, power of a): coefficient}
+
+def poly(value=0, c=0, a=0):
+    return {(c, a): Fraction(value)} if value != 0 else {}
+
+
+def add(p, q, sign=1):
+    r = dict(p)
+    for k, v in q.items():
+        r[k] = r.get(k, Fraction(0)) + sign * v
+        if r[k] == 0:
+            del r[k]
+    return r
+
+
+def mul(p, q):
+    r = {}
+    for (pc, pa), pv in p.items():
+        for (qc, qa), qv in q.items():
+            r = add(r, {(pc + qc, pa + qa): pv * qv})
+    return r
+
+
+def scale(p, s):
+    return {k: v * s for k, v in p.items() if v * s != 0}
+
+
+def at_a_zero(p):
+    return {k: v for k, v in p.items() if k[1] == 0}
+
+
+def divide_in_c(p, q):
+    """Quotient and remainder of polynomials in c alone"""
+    degree = lambda r: max(k[0] for k in r) if r else -1
+    quotient, remainder = {}, dict(p)
+    top = q[(degree(q), 0)]
+    while degree(remainder) >= degree(q):
+        shift = degree(remainder) - degree(q)
+        term = poly(remainder[(degree(remainder), 0)] / top, c=shift)
+        quotient = add(quotient, term)
+        remainder = add(remainder, mul(term, q), -1)
+    return quotient, remainder
+
+
+def reduce_ratio(numerator, denominator):
+    """Cancels the common factors of a ratio of polynomials in c, leaving the denominator monic"""
+    a, b = numerator, denominator
+    while b:
+        a, b = b, divide_in_c(a, b)[1]
+    numerator = divide_in_c(numerator, a)[0]
+    denominator = divide_in_c(denominator, a)[0]
+    top = denominator[max(denominator)]
+    return scale(numerator, 1 / top), scale(denominator, 1 / top)
+
+
+def literal(value):
+    text = "(temp){!r}".format(abs(float(value)))
+    return "-" + text if value < 0 else text
+
+
+def is_compound(text):
+    """True if text has a + or - outside brackets, so needs them as a factor"""
+    depth = 0
+    for k, ch in enumerate(text):
+        depth += ch == "("
+        depth -= ch == ")"
+        if depth == 0 and k > 0 and ch in "+-" and text[k - 1] == " ":
+            return True
+    return False
+
+
+def emit_poly(p):
+    """Horner form in c of Horner forms in a, with the coefficients folded"""
+    if not p:
+        return "(temp)0.0"
+
+    def times(text, name):
+        if text == "(temp)1.0":
+            return name
+        if text == "-(temp)1.0":
+            return "-" + name
+        return "({}) * {}".format(text, name) if is_compound(text) else "{} * {}".format(text, name)
+
+    def plus(text, term):
+        if text is None:
+            return term
+        if term.startswith("-") and not is_compound(term):
+            return "{} - {}".format(text, term[1:])
+        return "{} + {}".format(text, "({})".format(term) if is_compound(term) else term)
+
+    def horner(coefficients, name, emit):
+        text = None
+        for power in range(max(coefficients), -1, -1):
+            if power in coefficients:
+                text = plus(text, emit(coefficients[power]))
+            if power > 0 and text is not None:
+                text = times(text, name)
+        return text
+
+    by_c = {}
+    for (pc, pa), v in p.items():
+        by_c.setdefault(pc, {})[pa] = v
+    return horner(by_c, "c", lambda q: horner(q, "a", literal))
+
+
+def discretisation(net):
+    """Symbolic trapezoidal discretisation, with the distortion entry of A as a"""
+    reference = state_space(net, Fraction(0))
+    one = state_space(net, Fraction(1))
+    two = state_space(net, Fraction(2))
+
+    for name in ("B", "C", "D", "E", "F", "G", "vFeedthrough"):
+        if reference[name] != one[name] or reference[name] != two[name]:
+            raise NetlistError("the distortion resistor may only move A, but it moves " + name)
+    if any(v != 0 for v in reference["vFeedthrough"]):
+        raise NetlistError("the diode voltage must be set by the capacitor voltages alone")
+
+    moved = [(i, j) for i in range(3) for j in range(3) if one["A"][i][j] != reference["A"][i][j]]
+    if len(moved) != 1:
+        raise NetlistError("the distortion resistor must move exactly one entry of A, it moves {}".format(len(moved)))
+    row, col = moved[0]
+    slope = one["A"][row][col] - reference["A"][row][col]
+    if two["A"][row][col] - reference["A"][row][col] != 2 * slope:
+        raise NetlistError("A is not linear in the conductance of the distortion resistor")
+
+    # A = A0 + a e_row e_col^T, with a = A0[row][col] + slope / (fixed + distortion * pot)
+    A = [[poly(reference["A"][i][j]) if (i, j) != (row, col) else poly(1, a=1) for j in range(3)] for i in range(3)]
+    M = [[add(poly(1, c=1) if i == j else {}, A[i][j], -1) for j in range(3)] for i in range(3)]  # 2 fs I - A
+    N = [[add(poly(1, c=1) if i == j else {}, A[i][j]) for j in range(3)] for i in range(3)]       # 2 fs I + A
+
+    def cofactor(i, j):
+        r = [k for k in range(3) if k != i]
+        s = [k for k in range(3) if k != j]
+        minor = add(mul(M[r[0]][s[0]], M[r[1]][s[1]]), mul(M[r[0]][s[1]], M[r[1]][s[0]]), -1)
+        return minor if (i + j) % 2 == 0 else scale(minor, -1)
+
+    adj = [[cofactor(j, i) for j in range(3)] for i in range(3)]
+    det = {}
+    for j in range(3):
+        det = add(det, mul(M[0][j], cofactor(0, j)))
+
+    def times(matrix, vector):
+        return [sum_polys(mul(matrix[i][k], poly(vector[k])) for k in range(3)) for i in range(3)]
+
+    def row_times(vector, matrix):
+        return [sum_polys(mul(poly(vector[k]), matrix[k][j]) for k in range(3)) for j in range(3)]
+
+    def dot(vector, polys):
+        return sum_polys(mul(poly(vector[k]), polys[k]) for k in range(3))
+
+    zB = times(adj, reference["B"])
+    zC = times(adj, reference["C"])
+
+    return {
+        "reference": reference,
+        "row": row, "col": col,
+        "a0": reference["A"][row][col], "slope": slope,
+        "det": det,
+        "A_": [[sum_polys(mul(N[i][k], adj[k][j]) for k in range(3)) for j in range(3)] for i in range(3)],
+        "B_": [scale(p, 2) for p in zB],
+        "C_": [scale(p, 2) for p in zC],
+        "D_": [mul(poly(1, c=1), p) for p in row_times(reference["D"], adj)],
+        "G_": [mul(poly(1, c=1), p) for p in row_times(reference["G"], adj)],
+        "E_": (reference["E"], dot(reference["D"], zB)),
+        "F_": (reference["F"], dot(reference["D"], zC)),
+        "H_": dot(reference["G"], zB),
+        "K_": dot(reference["G"], zC),
+        "coupling": reduce_ratio(at_a_zero(adj[col][row]), at_a_zero(det)),
+    }
+
+
+def sum_polys(polys):
+    r = {}
+    for p in polys:
+        r = add(r, p)
+    return r
+
+
+def mask(polys):
+    return sum(1 << k for k, p in enumerate(polys) if p)
+
+
+def fnv1a(text):
+    h = 14695981039346656037
+    for byte in text.encode():
+        h = ((h ^ byte) * 1099511628211) % (1 << 64)
+    return h
+
+
+def format_matrix(rows):
+    return "\n".join("\t\t" + "  ".join("{:>13.6g}".format(float(v)) for v in row) for row in rows)
+
+
+def generate(net, source_name):
+    d = discretisation(net)
+    ref = d["reference"]
+    struct = net.name + "Circuit"
+    guard = struct + "_h"
+    pot = net.pot
+
+    # the id covers everything the discretised arrays depend on
+    canonical = ";".join(str(v) for v in (ref["A"], ref["B"], ref["C"], ref["D"], ref["E"], ref["F"], ref["G"],
+                                            d["row"], d["col"], d["slope"], pot[3], pot[4]))
+    circuit_id = fnv1a(canonical) & 0x7fffffffffffffff
+
+    out = []
+    w = out.append
+    w("/*-----------------------------------------------------------------------")
+    w(" ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING")
+    w(" Alistair Carson 2020")
+    w(" MSc Acoustics & Music Technology")
+    w(" University of Edinburgh")
+    w("--------------------------------------------------------------------*/")
+    w("")
+    w("// Generated by Tools/circuit_compiler.py from {}. Do not edit.".format(source_name))
+    w("")
+    w("#pragma once")
+    w("#ifndef " + guard)
+    w("#define " + guard)
+    w('#include "TSCircuit.h"')
+    w("")
+    w("/*")
+    if net.description:
+        w(net.description)
+        w("")
+    w("Netlist:")
+    for line in net.lines:
+        w("\t" + line)
+    w("")
+    w("States are the voltages across {}. Continuous time model:".format(", ".join(c[0] for c in net.capacitors)))
+    w("\tA =")
+    w(format_matrix(ref["A"]))
+    w("\tB = " + "  ".join("{:.6g}".format(float(v)) for v in ref["B"]))
+    w("\tC = " + "  ".join("{:.6g}".format(float(v)) for v in ref["C"]))
+    w("\tD = " + "  ".join("{:.6g}".format(float(v)) for v in ref["D"]))
+    w("\tE = {:.6g}, F = {:.6g}".format(float(ref["E"]), float(ref["F"])))
+    w("\tG = " + "  ".join("{:.6g}".format(float(v)) for v in ref["G"]))
+    w("with A[{}][{}] set by {}.".format(d["row"], d["col"], pot[0]))
+    w("*/")
+    w("struct " + struct)
+    w("{")
+    w("\tstatic constexpr int64 id = {};".format(circuit_id))
+    w("")
+    w('\tstatic const char* getName() {{ return "{}"; }}'.format(net.name))
+    w("")
+    w("\t// Entries of the discretised arrays that are not zero for every rate and distortion")
+    w("\tstatic constexpr int stateMask(int row) {{ return row == 0 ? {} : row == 1 ? {} : {}; }}".format(
+        *[mask(d["A_"][i]) for i in range(3)]))
+    w("\tstatic constexpr int inputMask = {};".format(mask(d["B_"])))
+    w("\tstatic constexpr int currentMask = {};".format(mask(d["C_"])))
+    w("\tstatic constexpr int outputMask = {};".format(mask(d["D_"])))
+    w("\tstatic constexpr int voltageMask = {};".format(mask(d["G_"])))
+    w("")
+    w("\t// {} = potFixed + distortion * potRange, in ohms".format(pot[0]))
+    w("\tstatic constexpr double potFixed = {};".format(literal(pot[3])[len("(temp)"):]))
+    w("\tstatic constexpr double potRange = {};".format(literal(pot[4])[len("(temp)"):]))
+    w("")
+    w("\t/*A[{}][{}] for a distortion setting, {} = {:g} + distortion * {:g}*/".format(d["row"], d["col"], pot[0], float(pot[3]), float(pot[4])))
+    w("\ttemplate <class temp>")
+    w("\tstatic temp potEntry(temp distortion)")
+    w("\t{")
+    entry = "{} / ({} + distortion * {})".format(literal(d["slope"]), literal(pot[3]), literal(pot[4]))
+    if d["a0"] != 0:
+        entry = "{} + {}".format(literal(d["a0"]), entry)
+    w("\t\treturn {};".format(entry))
+    w("\t}")
+    w("")
+    w("\t/*Z[{}][{}] with A[{}][{}] = 0, where Z = (2 fs I - A)^-1*/".format(d["col"], d["row"], d["row"], d["col"]))
+    w("\ttemplate <class temp>")
+    w("\tstatic temp potCoupling(temp fs)")
+    w("\t{")
+    w("\t\tconst temp c = (temp)2.0 * fs;")
+    numerator, denominator = (emit_poly(p) for p in d["coupling"])
+    bracket = lambda text: "({})".format(text) if is_compound(text) or " * " in text else text
+    if denominator == "(temp)1.0":
+        w("\t\treturn {};".format(numerator))
+    else:
+        w("\t\treturn {} / {};".format(bracket(numerator), bracket(denominator)))
+    w("\t}")
+    w("")
+    w("\t/*Discretised arrays with the trapezoidal rule, for A[{}][{}] = a*/".format(d["row"], d["col"]))
+    w("\ttemplate <class temp>")
+    w("\tstatic void discretise(temp a, temp fs, TSStateSpace<temp>& s)")
+    w("\t{")
+    w("\t\tconst temp c = (temp)2.0 * fs;")
+    w("\t\tconst temp invDet = (temp)1.0 / ({});".format(emit_poly(d["det"])))
+    w("")
+    w("\t\ts = TSStateSpace<temp>();")
+
+    def assign(target, p):
+        if p:
+            w("\t\t{} = ({}) * invDet;".format(target, emit_poly(p)))
+
+    for i in range(3):
+        for j in range(3):
+            assign("s.A_[{}][{}]".format(i, j), d["A_"][i][j])
+    for name in ("B_", "C_", "D_", "G_"):
+        for i in range(3):
+            assign("s.{}[{}]".format(name, i), d[name][i])
+    for name in ("E_", "F_"):
+        constant, p = d[name]
+        terms = ([literal(constant)] if constant != 0 else []) + (["({}) * invDet".format(emit_poly(p))] if p else [])
+        if terms:
+            w("\t\ts.{} = {};".format(name, " + ".join(terms)))
+    assign("s.H_", d["H_"])
+    assign("s.K_", d["K_"])
+    w("\t}")
+    w("};")
+    w("")
+    w("#endif // !" + guard)
+    w("")
+    return "\n".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compiles a clipping stage netlist into a circuit header for TSClippingStage.")
+    parser.add_argument("netlist")
+    parser.add_argument("-o", "--output", help="header to write, <name>Circuit.h next to the netlist by default")
+    args = parser.parse_args()
+
+    try:
+        net = Netlist(args.netlist)
+        header = generate(net, args.netlist.replace(os.sep, "/"))
+    except NetlistError as e:
+        sys.exit("error: {}".format(e))
+
+    output = args.output or os.path.join(os.path.dirname(args.netlist), net.name + "Circuit.h")
+    with open(output, "w") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,44 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef Mat3_h
+#define Mat3_h
+
+/*
+Fixed-size 3 element vector, used both as a column (B, C) and a row (D, G)
+of the state space model.
+
+The discretisation is done in closed form by the generated circuit, and the
+per-sample update runs across channel lanes with each coefficient broadcast,
+so this is storage only.
+*/
+template <class temp>
+struct Vec3
+{
+	temp v[3];
+
+	constexpr Vec3() : v{ 0, 0, 0 } {}
+	constexpr Vec3(temp x, temp y, temp z) : v{ x, y, z } {}
+
+	constexpr temp& operator[](int i) { return v[i]; }
+	constexpr const temp& operator[](int i) const { return v[i]; }
+};
+
+/*Fixed-size 3x3 matrix of Vec3 rows*/
+template <class temp>
+struct Mat3
+{
+	Vec3<temp> row[3];
+
+	constexpr Mat3() : row{} {}
+
+	constexpr Vec3<temp>& operator[](int i) { return row[i]; }
+	constexpr const Vec3<temp>& operator[](int i) const { return row[i]; }
+};
+
+#endif // !Mat3_h
@@ -0,0 +1,146 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+#pragma once
+#ifndef PiecewiseLagrangeInterp_h
+#define PiecewiseLagrangeInterp_h
+#include "UniformLagrangeInterp.h"
+#include <vector>
+template <class temp, int order = 3>
+
+/*
+Lagrange look-up on a piecewise uniform grid.
+
+The x range is split into equal-width buckets, and each bucket into its own
+number of equal-width cells, so points can be dense where the function bends
+and sparse where it is nearly polynomial. A look-up finds the bucket with one
+multiply, then the cell within it with another, and evaluates the cell's
+UniformLagrangeInterp coefficients. With a single bucket it is the same grid
+as UniformLagrangeInterp.
+
+Each bucket is made from its own uniform nodes, extended by numGhostNodes
+beyond both ends so every cell uses a centred stencil.
+*/
+class PiecewiseLagrangeInterp
+{
+public:
+	using Uniform = UniformLagrangeInterp<temp, order>;
+	using Position = typename Uniform::Position;
+
+	static constexpr int numCoeffs = Uniform::numCoeffs;
+
+	// nodes each side of a bucket needed by the centred stencils of its edge cells
+	static constexpr int numGhostNodes = (order - 1) / 2;
+
+	/*Sets equal-width buckets over [xMin, xMax] with the given number of cells in each*/
+	void setLayout(temp xMin, temp xMax, const std::vector<int>& cellsPerBucket)
+	{
+		x0 = xMin;
+		bucketWidth = (xMax - xMin) / (temp)cellsPerBucket.size();
+		invBucketWidth = (temp)1.0 / bucketWidth;
+		lastBucket = (temp)(cellsPerBucket.size() - 1);
+
+		buckets.resize(cellsPerBucket.size());
+		numCells = 0;
+		for (size_t b = 0; b < buckets.size(); b++)
+		{
+			buckets[b].firstCell = numCells;
+			buckets[b].numCells = cellsPerBucket[b];
+			buckets[b].scale = (temp)cellsPerBucket[b];
+			numCells += cellsPerBucket[b];
+		}
+	}
+
+	/*Points the interpolator at coefficients made for the current layout*/
+	void setCoefficients(const temp* coefficients)
+	{
+		coeffs = coefficients;
+	}
+
+	int getNumBuckets() const { return (int)buckets.size(); }
+	int getBucketCells(int bucket) const { return buckets[bucket].numCells; }
+	int getNumCells() const { return numCells; }
+	temp getXMin() const { return x0; }
+	temp getXMax() const { return x0 + bucketWidth * (temp)buckets.size(); }
+
+	/*Number of coefficients needed for the current layout*/
+	size_t getNumCoefficients() const
+	{
+		return (size_t)numCells * numCoeffs;
+	}
+
+	/*Number of nodes of a bucket, ghost nodes included*/
+	int getNumNodes(int bucket) const
+	{
+		return buckets[bucket].numCells + 1 + 2 * numGhostNodes;
+	}
+
+	/*x of node k of a bucket, where node 0 is the bucket's left edge and k may be a ghost node*/
+	double getNode(int bucket, int k) const
+	{
+		const double h = (double)bucketWidth / buckets[bucket].numCells;
+		return (double)x0 + (double)bucketWidth * bucket + h * (k - numGhostNodes);
+	}
+
+	/*
+	Makes one bucket's coefficients from the function values at its getNumNodes nodes.
+	coefficients is the whole table, getNumCoefficients values.
+	*/
+	void makeBucketCoefficients(int bucket, const double* nodeValues, temp* coefficients) const
+	{
+		const int numNodes = getNumNodes(bucket);
+		std::vector<temp> padded(Uniform::getNumCoefficients((size_t)numNodes));
+		Uniform::makeCoefficients(nodeValues, (size_t)numNodes, padded.data());
+
+		// the cells between the ghost nodes have centred stencils
+		std::copy(padded.begin() + numGhostNodes * numCoeffs,
+			padded.begin() + (numGhostNodes + buckets[bucket].numCells) * numCoeffs,
+			coefficients + (size_t)buckets[bucket].firstCell * numCoeffs);
+	}
+
+	/*Finds the cell of xq, clamped so that the edge cells extrapolate*/
+	inline Position locate(temp xq) const
+	{
+		const temp u = (xq - x0) * invBucketWidth;
+		const int b = (int)(u < 0 ? (temp)0 : (u > lastBucket ? lastBucket : u));
+		const Bucket& bucket = buckets[b];
+
+		const temp local = (u - (temp)b) * bucket.scale;
+		const temp lastCell = bucket.scale - 1;
+		const int cell = (int)(local < 0 ? (temp)0 : (local > lastCell ? lastCell : local));
+		return { bucket.firstCell + cell, local - (temp)cell };
+	}
+
+	/*Evaluates a coefficient table with the same layout at a located position*/
+	static inline temp evaluate(const temp* coefficients, Position pos)
+	{
+		return Uniform::evaluate(coefficients, pos);
+	}
+
+	/*Look-up function, xq - query sample*/
+	inline temp lookUp(temp xq) const
+	{
+		return evaluate(coeffs, locate(xq));
+	}
+
+private:
+	struct Bucket
+	{
+		int firstCell = 0;
+		int numCells = 1;
+		temp scale = 1.0;		// numCells as temp
+	};
+
+	temp x0 = 0.0;				// left edge of the first bucket
+	temp bucketWidth = 1.0;
+	temp invBucketWidth = 1.0;
+	temp lastBucket = 0.0;		// number of buckets - 1
+	int numCells = 0;
+	std::vector<Bucket> buckets;
+	const temp* coeffs = nullptr;
+};
+
+#endif // PiecewiseLagrangeInterp_h
@@ -34,6 +34,8 @@ TubeScreamerAudioProcessor::TubeScreamerAudioProcessor()
     std::make_unique < AudioParameterFloat >("output", "Level", 0.0f, 1.0f, 0.5f),
     std::make_unique < AudioParameterBool >("aa", "Anti-aliasing", 1),
     std::make_unique < AudioParameterChoice >("clip_type", "Clipping Type", StringArray{"Symmetric", "Asymmetric"}, 1),
+    std::make_unique < AudioParameterChoice >("os_factor", "Oversampling", StringArray{"1x", "2x", "4x", "8x", "16x"}, 1),
+    std::make_unique < AudioParameterChoice >("os_filter", "Oversampling Filter", StringArray{"Linear Phase FIR", "Polyphase IIR"}, 0),
         })
 
 {
@@ -43,13 +45,15 @@ TubeScreamerAudioProcessor::TubeScreamerAudioProcessor()
     tone = parameters.getRawParameterValue("tone");
     isAa = parameters.getRawParameterValue("aa");
     isSymm = parameters.getRawParameterValue("clip_type");
+    osFactor = parameters.getRawParameterValue("os_factor");
+    osFilter = parameters.getRawParameterValue("os_filter");
 
     parameters.state.addListener(this);
 }
 
 TubeScreamerAudioProcessor::~TubeScreamerAudioProcessor()
 {
-    
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -117,33 +121,55 @@ void TubeScreamerAudioProcessor::changeProgramName (int index, const juce::Strin
 //==============================================================================
 void TubeScreamerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    const int numChannels = getTotalNumInputChannels();
+    engineSettings = getOversamplingSettings();
+    preparedRate = sampleRate;
+    preparedBlockSize = samplesPerBlock;
+    preparedChannels = numChannels;
+
     // Oversampled sampling frequency
-    float fs = sampleRate * overSampling.getOversamplingFactor();
+    float fs = sampleRate * (1 << engineSettings.factorLog2);
 
     // Sine Osc - for testing only
     sineOsc.setSampleRate(fs);
     sineOsc.setFrequency(220.0);
 
-    // Output High Pass (DC Block)
-    highPassOut.setCoefficients(IIRCoefficients::makeHighPass(sampleRate, 3.0));
-
-    // Clipping
-    overSampling.initProcessing(samplesPerBlock);
-    regSymm.makeLookUpTable(32768, fs, 50.0, 1.0);
-    regAsymm.makeLookUpTable(32768, fs, 50.0, 1.0);
-    aaSymm.makeLookUpTable(32768, fs / 1.5, 50.0, 1.0);
-    aaAsymm.makeLookUpTable(32768, fs / 1.5, 50.0, 1.0);
-
-    // Tone
-    toneStage.setSampleRate(sampleRate);
-    toneStage.setTone(1.0f);
+    // Parameters the smoothers start from
+    blockParameters = readParameters();
+
+    // Clipping. Tables are built in the background when playing live; the
+    // anti-aliased stages use the explicit solver until they are ready
+    auto engines = std::make_shared<TSChannelGroups>(engineSettings, sampleRate, samplesPerBlock, numChannels,
+                                                     tableError, blockParameters.distortion, isNonRealtime());
+    cancelPendingUpdate();
+    pendingLatency = -1;
+    setLatencySamples(engines->getLatencySamples());
+    engineSlot->hold(nullptr);
+    blockEngines = nullptr;
+    fadingEngines = nullptr;
+    engineFadeRemaining = 0;
+    engineSlot->publish(std::move(engines), engineSlot->newRequest());
+
+    // Switching to engines rebuilt while playing
+    fadeBuffer.setSize(jmax(1, numChannels), jmax(1, samplesPerBlock));
+    engineWarmUpLength = jmax(1, roundToInt(TSClippingEngine::warmUpTime * sampleRate));
+    engineFadeLength = jmax(1, roundToInt(TSClippingEngine::crossfadeTime * sampleRate));
+
+    // Level, tone and output high pass (DC block)
+    const int numGroups = TSChannelGroups::getNumGroups(numChannels);
+    postStages.resize((size_t)numGroups);
+    for (int group = 0; group < numGroups; group++)
+        postStages[(size_t)group].prepare(sampleRate, samplesPerBlock, TSChannelGroups::getNumChannels(group, numChannels));
+    groupStates.resize((size_t)numGroups);
 
     // UI Parameters
     levelSmoothed.reset(sampleRate, 0.01);
     levelSmoothed.setCurrentAndTargetValue(0.0);
+    levelSmoothed.setTargetValue(blockParameters.level);
     toneSmoothed.reset(sampleRate, 0.01);
-    toneSmoothed.setCurrentAndTargetValue(0.0);
-    updatePluginParameters();
+    toneSmoothed.setCurrentAndTargetValue(powf(blockParameters.tone, 0.5));
+    distortionSmoothed.reset(sampleRate, 0.01);
+    distortionSmoothed.setCurrentAndTargetValue(blockParameters.distortion);
 
 }
 
@@ -159,10 +185,8 @@ bool TubeScreamerAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout: every channel runs its own pedal
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -186,64 +210,96 @@ void TubeScreamerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
         buffer.clear (i, 0, buffer.getNumSamples());
 
     // UI Params --------------------------------------------------
-    if (shouldUpdate)
-        updatePluginParameters();
+    const int changedFields = updatePluginParameters(readParameters());
+    int distortionUpdates = 0, toneUpdates = 0;
 
+    // Clipping engines for this block, picking up ones rebuilt for new oversampling settings
+    TSChannelGroups* engines = pickUpEngines(engineSlot->enter());
 
-    if (isOn)
+    if (isOn && engines != nullptr)
     {
-        // Non-linearity -------------------------------------------
-        // Upsample
-        AudioBlock<float> block{ buffer };
-        AudioBlock<float> upsampledBlock = overSampling.processSamplesUp(block);
-        float* newSamples = upsampledBlock.getChannelPointer(0);
-
-        // Loop
-        for (int i = 0; i < upsampledBlock.getNumSamples(); i++)
+        const int numChannels = jmin(buffer.getNumChannels(), totalNumInputChannels);
+        const int numGroups = jmin(TSChannelGroups::getNumGroups(numChannels), engines->getNumGroups(), (int)groupStates.size());
+
+        // Groups share nothing, so offline they run in parallel; live they
+        // stay on the host's thread
+        auto run = [&](int group) { processGroup(group, buffer, numChannels, *engines); };
+        if (isNonRealtime())
+            workerPool->run(numGroups, run);
+        else
+            for (int group = 0; group < numGroups; group++)
+                run(group);
+
+        TSSolverCounts blockCounts;
+        for (int group = 0; group < numGroups; group++)
         {
-            JUCE_SNAP_TO_ZERO(newSamples[i]);
-            // Sine wave - for testing only
-            //newSamples[i] = 0.1f * sineOsc.process();
-            newSamples[i] *= 0.95F;
-
-            if ((int)*isAa)         // if antialiasing on
-            { 
-                if ((int)*isSymm < 1)
-                    newSamples[i] = aaSymm.antiAliasedProcess(newSamples[i]);
-                else
-                    newSamples[i] = aaAsymm.antiAliasedProcess(newSamples[i]);
-            }
-            else                    // regular simulation
-            {
-                if ((int)*isSymm < 1)
-                    newSamples[i] = regSymm.process(newSamples[i], false);
-                else
-                    newSamples[i] = regAsymm.process(newSamples[i], false);
-            }
-
-            float outputLevel = levelSmoothed.getNextValue();
-            newSamples[i] *= outputLevel;
+            const auto& state = groupStates[(size_t)group];
+            blockCounts.add(state.solverCounts);
+            distortionUpdates += state.distortionUpdates;
+            toneUpdates += state.toneUpdates;
         }
 
-        // Downsample
-        overSampling.processSamplesDown(block);
+        // Every group advanced identical copies of the smoothers
+        if (numGroups > 0)
+        {
+            distortionSmoothed = groupStates[0].distortion;
+            toneSmoothed = groupStates[0].tone;
+            levelSmoothed = groupStates[0].level;
+        }
 
-        // Tone Stage -------------------------------------------
-        float* downSamples = buffer.getWritePointer(0);
-        toneStage.processBlock(downSamples, buffer.getNumSamples());
-        highPassOut.processSamples(downSamples, buffer.getNumSamples());
+        solverStats.addBlock(blockCounts);
+    }
 
-        // Copy to all output channels
-        for (int channel = 0; channel < totalNumInputChannels; channel++)
-        {
-            auto* channelData = buffer.getWritePointer(channel);
+    // Once the fade is over the replaced engines are no longer needed
+    engineFadeRemaining = jmax(0, engineFadeRemaining - buffer.getNumSamples());
+    if (fadingEngines != nullptr && engineFadeRemaining == 0)
+    {
+        fadingEngines = nullptr;
+        engineSlot->hold(blockEngines);
+    }
 
-            for (int i = 0; i < buffer.getNumSamples(); i++)
-            {
-                channelData[i] = downSamples[i];
-            }
-        }
+    engineSlot->exit();
+    parameterStats.addBlock(changedFields, distortionUpdates, toneUpdates);
+}
+
+/*Clips and filters one channel group of the block, on whichever thread runs it*/
+void TubeScreamerAudioProcessor::processGroup(int group, AudioBuffer<float>& buffer, int numChannels, TSChannelGroups& engines)
+{
+    auto& state = groupStates[(size_t)group];
+    const int first = TSChannelGroups::getFirstChannel(group);
+    const int count = TSChannelGroups::getNumChannels(group, numChannels);
+
+    state.distortion = distortionSmoothed;
+    state.tone = toneSmoothed;
+    state.level = levelSmoothed;
+    state.solverCounts = TSSolverCounts();
+    state.distortionUpdates = 0;
+
+    // Engines being replaced clip a copy of the input while the switch
+    // lasts, and are all that is heard until the new ones have warmed up
+    const int numFading = fadingEngines != nullptr ? jmin(buffer.getNumSamples(), engineFadeRemaining, fadeBuffer.getNumSamples()) : 0;
+    if (numFading > 0)
+    {
+        for (int channel = first; channel < first + count; channel++)
+            fadeBuffer.copyFrom(channel, 0, buffer, channel, 0, numFading);
+
+        AudioBlock<float> fadeBlock = AudioBlock<float>(fadeBuffer).getSubsetChannelBlock((size_t)first, (size_t)count).getSubBlock(0, (size_t)numFading);
+        SmoothedValue<float> fadeDistortion = state.distortion;
+        TSSolverCounts fadeCounts;
+        fadingEngines->getEngine(group).process(fadeBlock, blockParameters.aa, blockParameters.symm, fadeDistortion, fadeCounts);
     }
+
+    // Non-linearity -------------------------------------------
+    AudioBlock<float> block = AudioBlock<float>(buffer).getSubsetChannelBlock((size_t)first, (size_t)count);
+    state.distortionUpdates += engines.getEngine(group).process(block, blockParameters.aa, blockParameters.symm,
+                                                                state.distortion, state.solverCounts);
+
+    if (numFading > 0)
+        crossfadeEngines(buffer, first, count, numFading);
+
+    // Output level, tone and DC block in one pass at the base rate
+    state.toneUpdates = postStages[(size_t)group].process(buffer.getArrayOfWritePointers() + first, count,
+                                                          buffer.getNumSamples(), state.level, state.tone);
 }
 
 //==============================================================================
@@ -273,6 +329,7 @@ void TubeScreamerAudioProcessor::setStateInformation (const void* data, int size
         if (xmlState->hasTagName(parameters.state.getType()))
         {
             parameters.replaceState(ValueTree::fromXml(*xmlState));
+            requestClippingEngine();
         }
     }
 }
@@ -284,19 +341,134 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
     return new TubeScreamerAudioProcessor();
 }
 
-/*Update plugin parameters*/
-void TubeScreamerAudioProcessor::updatePluginParameters()
-{ 
-    regSymm.setDistortion(*distortion);
-    regAsymm.setDistortion(*distortion);
-    aaSymm.setDistortion(*distortion);
-    aaAsymm.setDistortion(*distortion);
-    float toneLog = powf(*tone, 0.5);
-    toneStage.setTone(toneLog);
-    levelSmoothed.setTargetValue(*out);
+TSParameterSnapshot TubeScreamerAudioProcessor::readParameters() const
+{
+    return TSParameterSnapshot::read(*distortion, *tone, *out, *isAa, *isSymm, *osFactor, *osFilter);
+}
+
+/*
+Update plugin parameters. Retargets the smoothers of the fields that changed
+since the last block and returns them as a mask of TSParameterSnapshot::Field.
+The clip mode is read from blockParameters; oversampling changes are handled
+on the message thread by requestClippingEngine.
+*/
+int TubeScreamerAudioProcessor::updatePluginParameters(const TSParameterSnapshot& next)
+{
+    const int changed = next.changedFields(blockParameters);
+    blockParameters = next;
+
+    if ((changed & TSParameterSnapshot::distortionField) != 0)
+        distortionSmoothed.setTargetValue(next.distortion);
+
+    if ((changed & TSParameterSnapshot::toneField) != 0)
+    {
+        float toneLog = powf(next.tone, 0.5);
+        toneSmoothed.setTargetValue(toneLog);
+    }
+
+    if ((changed & TSParameterSnapshot::levelField) != 0)
+        levelSmoothed.setTargetValue(next.level);
+
+    return changed;
 }
 
 void TubeScreamerAudioProcessor::valueTreePropertyChanged(ValueTree& treeWhosePropertyHasChanged, const Identifier& property)
 {
-    shouldUpdate = true;
-}
\ No newline at end of file
+    // The parameter tree is written on the message thread
+    requestClippingEngine();
+}
+
+TSClippingEngine::Settings TubeScreamerAudioProcessor::getOversamplingSettings() const
+{
+    TSClippingEngine::Settings settings;
+    settings.factorLog2 = (int)*osFactor;
+    settings.filterType = (int)*osFilter;
+    return settings;
+}
+
+/*
+Builds an engine for new oversampling settings on the table build thread,
+tables included, so the switch does not fall back to the explicit solver.
+The host is told the new latency when the audio thread picks it up.
+*/
+void TubeScreamerAudioProcessor::requestClippingEngine()
+{
+    const auto settings = getOversamplingSettings();
+    if (settings == engineSettings || preparedRate <= 0.0)
+        return;
+
+    engineSettings = settings;
+    parameterStats.addEngineRequest();
+
+    const uint64 request = engineSlot->newRequest();
+    engineSlot->collectGarbage();
+
+    // The job only holds the slot, so the processor may be destroyed before it runs
+    auto slot = engineSlot;
+    const double rate = preparedRate, error = tableError, dist = *distortion;
+    const int blockSize = preparedBlockSize, numChannels = preparedChannels;
+    buildPool->addJob([slot, settings, rate, blockSize, numChannels, error, dist, request]
+    {
+        slot->publish(std::make_shared<TSChannelGroups>(settings, rate, blockSize, numChannels, error, dist, true), request);
+    });
+}
+
+/*
+Audio thread: returns the engines for this block. Newly published ones
+replace those in use, which are held in the slot and heard alone for
+engineWarmUpLength samples while the new ones warm up, then faded out over
+engineFadeLength; engines published during a switch wait for it to end.
+If the latency changes, the host is told from the message thread.
+*/
+TSChannelGroups* TubeScreamerAudioProcessor::pickUpEngines(TSChannelGroups* latest)
+{
+    if (latest == blockEngines || latest == nullptr || engineFadeRemaining > 0)
+        return blockEngines;
+
+    if (blockEngines != nullptr && latest->getLatencySamples() != blockEngines->getLatencySamples())
+    {
+        pendingLatency = latest->getLatencySamples();
+        triggerAsyncUpdate();
+    }
+
+    fadingEngines = isOn ? blockEngines : nullptr;
+    blockEngines = latest;
+    engineSlot->hold(blockEngines, fadingEngines);
+
+    if (fadingEngines != nullptr)
+        engineFadeRemaining = engineWarmUpLength + engineFadeLength;
+
+    return blockEngines;
+}
+
+/*
+Raised cosine crossfade from the outgoing engines' output in fadeBuffer to
+the new engines' in buffer, after engineWarmUpLength samples of the outgoing
+engines alone
+*/
+void TubeScreamerAudioProcessor::crossfadeEngines(AudioBuffer<float>& buffer, int first, int count, int numFading)
+{
+    const int done = engineWarmUpLength + engineFadeLength - engineFadeRemaining;
+    const float step = MathConstants<float>::pi / (float)engineFadeLength;
+
+    for (int channel = first; channel < first + count; channel++)
+    {
+        float* active = buffer.getWritePointer(channel);
+        const float* fading = fadeBuffer.getReadPointer(channel);
+
+        for (int i = 0; i < numFading; i++)
+        {
+            const int faded = done + i - engineWarmUpLength;
+            const float gain = faded <= 0 ? 0.0f : 0.5f - 0.5f * std::cos(step * (float)faded);
+            active[i] = fading[i] + gain * (active[i] - fading[i]);
+        }
+    }
+}
+
+/*Message thread: reports the latency of engines the audio thread has picked up*/
+void TubeScreamerAudioProcessor::handleAsyncUpdate()
+{
+    const int latency = pendingLatency.exchange(-1);
+    if (latency >= 0)
+        setLatencySamples(latency);
+}
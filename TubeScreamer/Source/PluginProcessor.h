@@ -16,8 +16,10 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "TSClippingStage.h"
-#include "TSTone.h"
+#include "TSChannelGroups.h"
+#include "TSWorkerPool.h"
+#include "TSPostStage.h"
+#include "TSParameters.h"
 #include "Oscillator.h"
 using namespace juce;
 
@@ -25,7 +27,8 @@ using namespace juce;
 /**
 */
 class TubeScreamerAudioProcessor  : public juce::AudioProcessor,
-                                    public juce::ValueTree::Listener
+                                    public juce::ValueTree::Listener,
+                                    private juce::AsyncUpdater
                                     
 {
 public:
@@ -69,6 +72,15 @@ public:
     
 
     AudioProcessorValueTreeState& getAPVTS() { return parameters; };
+
+    // Solver counts of the clipping stages, per processed block. Safe to call from any thread
+    TSSolverStats::Snapshot getSolverStats() const { return solverStats.get(); }
+    void resetSolverStats() { solverStats.reset(); }
+
+    // How often each piece of parameter dependent state was recomputed. Safe to call from any thread
+    TSParameterCounts getParameterCounts() const { return parameterStats.get(); }
+    void resetParameterCounts() { parameterStats.reset(); }
+
     bool isOn;
     std::atomic <float>* gain = nullptr;
     std::atomic <float>* distortion = nullptr;
@@ -76,32 +88,78 @@ public:
     std::atomic <float>* out = nullptr;
     std::atomic <float>* isAa = nullptr;
     std::atomic <float>* isSymm = nullptr;
+    std::atomic <float>* osFactor = nullptr;
+    std::atomic <float>* osFilter = nullptr;
 
 private:
     AudioProcessorValueTreeState parameters;
-    void updatePluginParameters();
     void valueTreePropertyChanged(ValueTree& treeWhosePropertyHasChanged, const Identifier& property) override;
-    std::atomic<bool> shouldUpdate{ false };
+
+    // Parameters are read once per block and compared with the last block's,
+    // so only the state that depends on a changed field is updated
+    TSParameterSnapshot readParameters() const;
+    int updatePluginParameters(const TSParameterSnapshot& next);
+    TSParameterSnapshot blockParameters;
+    TSParameterStats parameterStats;
+
     SmoothedValue<float> distortionSmoothed;
     SmoothedValue<float> toneSmoothed;
     SmoothedValue<float> levelSmoothed;
 
-    // High pass filter
-    IIRFilter highPassOut;
-
-    // Nonlinearities
-    TSClippingStage<double> regSymm{TSClippingStage<double>::ClippingType::symmetric};
-    TSClippingStage<double> regAsymm{ TSClippingStage<double>::ClippingType::asymmetric };
-    TSClippingStage<double> aaSymm{ TSClippingStage<double>::ClippingType::symmetric };
-    TSClippingStage<double> aaAsymm{ TSClippingStage<double>::ClippingType::asymmetric };
-
-    // Oversampling
-    int os = 1;
-    Oversampling<float> overSampling{ (size_t)2, (size_t)os,
-                                    Oversampling<float>::filterHalfBandFIREquiripple , true, false };
-
-    // Tone Stage
-    TSTone<float> toneStage;
+    // Oversampling and nonlinearities, one engine per channel group. New
+    // engines are built on the table build thread when the oversampling
+    // settings change, and the audio thread picks them up at the start of a block
+    TSClippingEngine::Settings getOversamplingSettings() const;
+    void requestClippingEngine();
+    std::shared_ptr<TSTableSlot<TSChannelGroups>> engineSlot = std::make_shared<TSTableSlot<TSChannelGroups>>();
+    SharedResourcePointer<TSTableBuildPool> buildPool;
+
+    // Engines picked up from the slot run muted on the live input for a
+    // warm-up time, then are faded in from the ones they replace. Their
+    // latency is reported to the host from the message thread once they are
+    // picked up. Audio thread only, apart from pendingLatency
+    TSChannelGroups* pickUpEngines(TSChannelGroups* latest);
+    void crossfadeEngines(AudioBuffer<float>& buffer, int first, int count, int numFading);
+    void handleAsyncUpdate() override;
+    TSChannelGroups* blockEngines = nullptr;
+    TSChannelGroups* fadingEngines = nullptr;
+    int engineWarmUpLength = 1;
+    int engineFadeLength = 1;
+    int engineFadeRemaining = 0;
+    std::atomic<int> pendingLatency { -1 };
+
+    // The outgoing engines' output during a switch
+    AudioBuffer<float> fadeBuffer;
+
+    // Channel groups are spread over these threads when rendering offline
+    SharedResourcePointer<TSWorkerPool> workerPool;
+
+    // What one channel group works with and reports for a block. Each group
+    // advances its own copy of the smoothers, so groups never share state
+    struct GroupState
+    {
+        SmoothedValue<float> distortion, tone, level;
+        TSSolverCounts solverCounts;
+        int distortionUpdates = 0;
+        int toneUpdates = 0;
+    };
+
+    void processGroup(int group, AudioBuffer<float>& buffer, int numChannels, TSChannelGroups& engines);
+    std::vector<GroupState> groupStates;
+
+    // Last requested settings and the configuration they were built for, message thread only
+    TSClippingEngine::Settings engineSettings;
+    double preparedRate = 0.0;
+    int preparedBlockSize = 0;
+    int preparedChannels = 0;
+
+    TSSolverStats solverStats;
+
+    // Largest interpolation error of the anti-aliased stages' tables, in volts
+    const double tableError = 1.0e-5;
+
+    // Output level, tone stage and high pass filter, per channel group
+    std::vector<TSPostStage<float>> postStages;
 
     // Sine input for testing
     SineOsc sineOsc;
@@ -0,0 +1,107 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+// Generated by Tools/circuit_compiler.py from Tools/Circuits/TS808Fat.cir. Do not edit.
+
+#pragma once
+#ifndef TS808FatCircuit_h
+#define TS808FatCircuit_h
+#include "TSCircuit.h"
+
+/*
+Tube Screamer TS808 clipping stage with the 100n "fat" capacitor.
+
+Netlist:
+	.name TS808Fat
+	.description Tube Screamer TS808 clipping stage with the 100n "fat" capacitor.
+	.output out
+	Vin in 0
+	C1 in p 1u
+	R1 p 0 10k
+	U1 p n out
+	R3 n m 4.7k
+	C2 out n 51p
+	C3 m 0 100n
+	RV2 out n 51k 500k
+	D1 out n
+
+States are the voltages across C1, C2, C3. Continuous time model:
+	A =
+		         -100              0              0
+		 -4.17188e+06              0   -4.17188e+06
+		     -2127.66              0       -2127.66
+	B = 100  4.17188e+06  2127.66
+	C = 0  -1.96078e+10  0
+	D = -1  1  0
+	E = 1, F = 0
+	G = 0  1  0
+with A[1][1] set by RV2.
+*/
+struct TS808FatCircuit
+{
+	static constexpr int64 id = 1072977838323648219;
+
+	static const char* getName() { return "TS808Fat"; }
+
+	// Entries of the discretised arrays that are not zero for every rate and distortion
+	static constexpr int stateMask(int row) { return row == 0 ? 1 : row == 1 ? 7 : 5; }
+	static constexpr int inputMask = 7;
+	static constexpr int currentMask = 2;
+	static constexpr int outputMask = 7;
+	static constexpr int voltageMask = 7;
+
+	// RV2 = potFixed + distortion * potRange, in ohms
+	static constexpr double potFixed = 51000.0;
+	static constexpr double potRange = 500000.0;
+
+	/*A[1][1] for a distortion setting, RV2 = 51000 + distortion * 500000*/
+	template <class temp>
+	static temp potEntry(temp distortion)
+	{
+		return -(temp)19607843137.2549 / ((temp)51000.0 + distortion * (temp)500000.0);
+	}
+
+	/*Z[1][1] with A[1][1] = 0, where Z = (2 fs I - A)^-1*/
+	template <class temp>
+	static temp potCoupling(temp fs)
+	{
+		const temp c = (temp)2.0 * fs;
+		return (temp)1.0 / c;
+	}
+
+	/*Discretised arrays with the trapezoidal rule, for A[1][1] = a*/
+	template <class temp>
+	static void discretise(temp a, temp fs, TSStateSpace<temp>& s)
+	{
+		const temp c = (temp)2.0 * fs;
+		const temp invDet = (temp)1.0 / (((c + (-a + (temp)2227.659574468085)) * c + (-(temp)2227.659574468085 * a + (temp)212765.95744680852)) * c - (temp)212765.95744680852 * a);
+
+		s = TSStateSpace<temp>();
+		s.A_[0][0] = (((c + (-a + (temp)2027.659574468085)) * c + (-(temp)2027.659574468085 * a - (temp)212765.95744680852)) * c + (temp)212765.95744680852 * a) * invDet;
+		s.A_[1][0] = (-(temp)8343763.037129746 * c * c) * invDet;
+		s.A_[1][1] = (((c + (a + (temp)2227.659574468085)) * c + ((temp)2227.659574468085 * a + (temp)212765.95744680852)) * c + (temp)212765.95744680852 * a) * invDet;
+		s.A_[1][2] = ((-(temp)8343763.037129746 * c - (temp)834376303.7129745) * c) * invDet;
+		s.A_[2][0] = ((-(temp)4255.31914893617 * c + (temp)4255.31914893617 * a) * c) * invDet;
+		s.A_[2][2] = (((c + (-a - (temp)2027.659574468085)) * c + ((temp)2027.659574468085 * a - (temp)212765.95744680852)) * c + (temp)212765.95744680852 * a) * invDet;
+		s.B_[0] = (((temp)200.0 * c + (-(temp)200.0 * a + (temp)425531.91489361704)) * c - (temp)425531.91489361704 * a) * invDet;
+		s.B_[1] = ((temp)8343763.037129746 * c * c) * invDet;
+		s.B_[2] = (((temp)4255.31914893617 * c - (temp)4255.31914893617 * a) * c) * invDet;
+		s.C_[1] = ((-(temp)39215686274.5098 * c - (temp)87359198998748.44) * c - (temp)8343763037129746.0) * invDet;
+		s.D_[0] = (((-c + (a - (temp)4174009.178139341)) * c + (temp)2127.659574468085 * a) * c) * invDet;
+		s.D_[1] = (((c + (temp)2227.659574468085) * c + (temp)212765.95744680852) * c) * invDet;
+		s.D_[2] = ((-(temp)4171881.518564873 * c - (temp)417188151.8564873) * c) * invDet;
+		s.G_[0] = (-(temp)4171881.518564873 * c * c) * invDet;
+		s.G_[1] = (((c + (temp)2227.659574468085) * c + (temp)212765.95744680852) * c) * invDet;
+		s.G_[2] = ((-(temp)4171881.518564873 * c - (temp)417188151.8564873) * c) * invDet;
+		s.E_ = (temp)1.0 + (((temp)4171781.518564873 * c + ((temp)100.0 * a - (temp)212765.95744680852)) * c + (temp)212765.95744680852 * a) * invDet;
+		s.F_ = ((-(temp)19607843137.2549 * c - (temp)43679599499374.22) * c - (temp)4171881518564873.0) * invDet;
+		s.H_ = ((temp)4171881.518564873 * c * c) * invDet;
+		s.K_ = ((-(temp)19607843137.2549 * c - (temp)43679599499374.22) * c - (temp)4171881518564873.0) * invDet;
+	}
+};
+
+#endif // !TS808FatCircuit_h
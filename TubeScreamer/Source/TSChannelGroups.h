@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSChannelGroups_h
+#define TSChannelGroups_h
+#include "JuceHeader.h"
+#include "TSClippingEngine.h"
+
+using namespace juce;
+
+/*
+Clipping engines for a bus of any width.
+
+The bus is split into groups of channelsPerGroup channels, each with its own
+oversampler and stages, so groups share no state and can be processed on
+different threads. Every pedal channel is independent, whatever the layout.
+Engines of the same settings and rate share their look-up tables through the
+table registry, so extra groups cost no table builds.
+*/
+class TSChannelGroups
+{
+public:
+	// A pair fills the SIMD lanes of the double precision stages
+	static constexpr int channelsPerGroup = 2;
+
+	static int getNumGroups(int numChannels)
+	{
+		return (numChannels + channelsPerGroup - 1) / channelsPerGroup;
+	}
+
+	static int getFirstChannel(int group)
+	{
+		return group * channelsPerGroup;
+	}
+
+	/*Channels of a group that are present in a bus of numChannels, 0 if none*/
+	static int getNumChannels(int group, int numChannels)
+	{
+		return jlimit(0, channelsPerGroup, numChannels - getFirstChannel(group));
+	}
+
+	/*Creates one engine per group. Arguments are as for TSClippingEngine*/
+	TSChannelGroups(const TSClippingEngine::Settings& engineSettings, double baseRate, int maxBlockSize, int numChannels,
+		double tableError, double distortion, bool buildTablesNow)
+	{
+		for (int group = 0; group < jmax(1, getNumGroups(numChannels)); group++)
+			engines.push_back(std::make_unique<TSClippingEngine>(engineSettings, baseRate, maxBlockSize,
+				jmax(1, getNumChannels(group, numChannels)), tableError, distortion, buildTablesNow));
+	}
+
+	int getNumGroups() const { return (int)engines.size(); }
+
+	TSClippingEngine& getEngine(int group) { return *engines[(size_t)group]; }
+
+	/*Every group has the same latency*/
+	int getLatencySamples() const { return engines.front()->getLatencySamples(); }
+
+	const TSClippingEngine::Settings& getSettings() const { return engines.front()->getSettings(); }
+
+private:
+	std::vector<std::unique_ptr<TSClippingEngine>> engines;
+};
+
+#endif // !TSChannelGroups_h
@@ -0,0 +1,49 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSCircuit_h
+#define TSCircuit_h
+#include "JuceHeader.h"
+#include "Mat3.h"
+
+using namespace juce;
+
+/*
+Discretised state space model of a clipping stage, one sample at a time:
+
+	p[n] = G_ x[n-1] + H_ u[n]				(diode voltage v = p + K_ i)
+	x[n] = A_ x[n-1] + B_ u[n] + C_ i[n]
+	y[n] = D_ x[n-1] + E_ u[n] + F_ i[n]
+*/
+template <class temp>
+struct TSStateSpace
+{
+	Mat3<temp> A_;
+	Vec3<temp> B_, C_, D_, G_;
+	temp E_ = 0, F_ = 0, H_ = 0, K_ = 0;
+};
+
+/*
+The circuit of a TSClippingStage is a compile-time policy, generated from a
+netlist by Tools/circuit_compiler.py (see TS808Circuit.h). It provides:
+
+	id						int64 identifying the circuit in look-up table keys
+	getName()				name of the circuit
+	stateMask(row)			bit j set if A_[row][j] can be non-zero
+	inputMask, currentMask, outputMask, voltageMask
+							the same for B_, C_, D_ and G_
+	potFixed, potRange		the distortion resistor is potFixed + distortion * potRange
+	potEntry(distortion)	the one entry of the continuous A that distortion moves
+	potCoupling(fs)			the matching entry of (2 fs I - A)^-1, with potEntry 0
+	discretise(a, fs, s)	the arrays above for potEntry a
+
+Entries outside the masks are zero for every rate and distortion, so the
+stage leaves them out of its per-sample update.
+*/
+
+#endif // !TSCircuit_h
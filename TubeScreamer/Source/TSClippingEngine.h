@@ -0,0 +1,343 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSClippingEngine_h
+#define TSClippingEngine_h
+#include "JuceHeader.h"
+#include "TSClippingStage.h"
+#include "TSSolverStats.h"
+
+using namespace juce;
+using namespace dsp;
+
+/*
+The oversampler and the clipping stages running at its rate.
+
+Everything that depends on the oversampling settings lives here, so a new
+engine can be built off the audio thread when they change and handed over
+whole through a TSTableSlot.
+
+Only the stage selected by aa and clip_type is kept up to date with the
+distortion. When the selection changes, the new stage catches up and runs
+muted alongside the old one for warmUpTime, so it is warmed up on the live
+input a block at a time rather than on a replay of past input within one
+block. It then takes over with a crossfade of crossfadeTime. Both stages
+run throughout the switch, so it costs at most one extra stage per sample.
+The two outputs are near copies of each other, so the fade gains sum to one
+(a raised cosine) rather than their squares, which would swell the mix by
+up to 3 dB.
+*/
+class TSClippingEngine
+{
+public:
+	using SymmetricStage = TSClippingStage<double, SymmetricClipping>;
+	using AsymmetricStage = TSClippingStage<double, AsymmetricClipping>;
+
+	/*Oversampling choices, as exposed by the plugin parameters*/
+	struct Settings
+	{
+		int factorLog2 = 1;		// 0 - 4, for 1x - 16x
+		int filterType = 0;		// 0: linear phase FIR, 1: polyphase IIR
+
+		bool operator==(const Settings& other) const { return factorLog2 == other.factorLog2 && filterType == other.filterType; }
+		bool operator!=(const Settings& other) const { return !(*this == other); }
+	};
+
+	static constexpr int maxFactorLog2 = 4;
+
+	/*
+	Creates an engine for a base rate. With buildTablesNow the anti-aliased
+	stages' tables are built before returning, otherwise they are requested in
+	the background and those stages use the explicit solver until they are
+	ready.
+	*/
+	TSClippingEngine(const Settings& engineSettings, double baseRate, int maxBlockSize, int numChannels,
+		double tableError, double distortion, bool buildTablesNow)
+		: settings(engineSettings), overSampling(makeOversampling(engineSettings, numChannels))
+	{
+		overSampling->initProcessing((size_t)maxBlockSize);
+		const double fs = baseRate * overSampling->getOversamplingFactor();
+
+		for (auto* stage : { &regSymm, &aaSymm })
+		{
+			stage->setNumChannels(numChannels);
+			stage->setSolver(SymmetricStage::Solver::wrightOmega);
+		}
+		for (auto* stage : { &regAsymm, &aaAsymm })
+		{
+			stage->setNumChannels(numChannels);
+			stage->setSolver(AsymmetricStage::Solver::wrightOmega);
+		}
+
+		regSymm.setProcessMode(SymmetricStage::ProcessMode::newton);
+		regAsymm.setProcessMode(AsymmetricStage::ProcessMode::newton);
+		aaSymm.setProcessMode(SymmetricStage::ProcessMode::antiAliased);
+		aaAsymm.setProcessMode(AsymmetricStage::ProcessMode::antiAliased);
+		regSymm.setSampleRate(fs);
+		regAsymm.setSampleRate(fs);
+
+		if (buildTablesNow)
+		{
+			aaSymm.makeBoundedLookUpTable(fs / 1.5, tableError);
+			aaAsymm.makeBoundedLookUpTable(fs / 1.5, tableError);
+		}
+		else
+		{
+			aaSymm.requestBoundedLookUpTable(fs / 1.5, tableError);
+			aaAsymm.requestBoundedLookUpTable(fs / 1.5, tableError);
+		}
+
+		setDistortion(distortion);
+		channelPointers.assign((size_t)numChannels, nullptr);
+		fadePointers.assign((size_t)numChannels, nullptr);
+
+		const int factor = (int)overSampling->getOversamplingFactor();
+		scratch.setSize(numChannels, jmax(1, maxBlockSize) * factor);
+		warmUpLength = jmax(1, roundToInt(warmUpTime * baseRate)) * factor;
+		crossfadeLength = jmax(1, roundToInt(crossfadeTime * baseRate)) * factor;
+	}
+
+	/*Latency of the oversampling filters at the base rate, a whole number of samples*/
+	int getLatencySamples() const
+	{
+		return roundToInt(overSampling->getLatencyInSamples());
+	}
+
+	/*Latency an engine with these settings would have, without building one*/
+	static int getLatencySamples(const Settings& engineSettings)
+	{
+		auto probe = makeOversampling(engineSettings, 1);
+		probe->initProcessing(1);
+		return roundToInt(probe->getLatencyInSamples());
+	}
+
+	const Settings& getSettings() const { return settings; }
+
+	/*Clears the oversampling filters and every stage, as for a new stream*/
+	void reset()
+	{
+		overSampling->reset();
+		for (int index = 0; index < 4; index++)
+			withStage(index, [](auto& s) { s.reset(); });
+
+		activeStage = -1;
+		fadeRemaining = 0;
+	}
+
+	/*Updates the active stage, and the one fading out. Returns the number of stages updated*/
+	int setDistortion(double distortion)
+	{
+		distortionValue = distortion;
+		int numUpdates = 0;
+
+		if (activeStage >= 0)
+			numUpdates += catchUp(activeStage);
+		if (fadeRemaining > 0)
+			numUpdates += catchUp(fadingStage);
+
+		return numUpdates;
+	}
+
+	/*
+	Clips the first numChannels channels of the block in place: upsampling,
+	the selected stage, then downsampling. While the distortion is smoothing
+	it is updated every distortionSubBlock base rate samples. Adds the
+	stage's solver counts for the block to counts. Returns the number of
+	stage distortion updates made.
+	*/
+	int process(AudioBlock<float>& block, bool useAa, bool useSymm, SmoothedValue<float>& distortion, TSSolverCounts& counts)
+	{
+		AudioBlock<float> upsampledBlock = overSampling->processSamplesUp(block);
+		const int numChannels = (int)jmin(upsampledBlock.getNumChannels(), channelPointers.size());
+		const int factor = (int)overSampling->getOversamplingFactor();
+		upsampledBlock.multiplyBy(0.95f);
+
+		int numUpdates = 0;
+		const int stage = (useAa ? 2 : 0) + (useSymm ? 0 : 1);
+		if (stage != activeStage)
+			numUpdates += selectStage(stage);
+
+		if (!distortion.isSmoothing() && (double)distortion.getTargetValue() != distortionValue)
+			numUpdates += setDistortion(distortion.getTargetValue());
+
+		const int numSamples = (int)block.getNumSamples();
+
+		for (int pos = 0; pos < numSamples;)
+		{
+			int n = numSamples - pos;
+			if (distortion.isSmoothing())
+			{
+				n = jmin(n, distortionSubBlock);
+				numUpdates += setDistortion(distortion.skip(n));
+			}
+
+			for (int channel = 0; channel < numChannels; channel++)
+				channelPointers[channel] = upsampledBlock.getChannelPointer(channel) + pos * factor;
+
+			// The outgoing stage clips a copy of the input while the switch lasts
+			const int numFading = jmin(n * factor, fadeRemaining);
+			if (numFading > 0)
+			{
+				for (int channel = 0; channel < numChannels; channel++)
+				{
+					fadePointers[channel] = scratch.getWritePointer(channel);
+					std::copy(channelPointers[channel], channelPointers[channel] + numFading, fadePointers[channel]);
+				}
+
+				withStage(fadingStage, [&](auto& s) { s.processBlock(fadePointers.data(), fadePointers.data(), numChannels, numFading); });
+			}
+
+			withStage(activeStage, [&](auto& s)
+			{
+				s.processBlock(channelPointers.data(), channelPointers.data(), numChannels, n * factor);
+				counts.add(s.getBlockSolverCounts());
+			});
+
+			if (numFading > 0)
+				crossfade(numChannels, numFading);
+
+			pos += n;
+		}
+
+		overSampling->processSamplesDown(block);
+		return numUpdates;
+	}
+
+	// Base rate samples between distortion updates while it is smoothing
+	static constexpr int distortionSubBlock = 32;
+
+	// Input a newly selected stage runs on muted before it is heard, and the
+	// length of the crossfade to it, in seconds
+	static constexpr double warmUpTime = 0.01;
+	static constexpr double crossfadeTime = 0.005;
+
+private:
+	/*
+	Integer latency, so the value reported to the host is exact: the
+	oversampler pads the filters' delay with a fractional delay line.
+	*/
+	static std::unique_ptr<Oversampling<float>> makeOversampling(const Settings& engineSettings, int numChannels)
+	{
+		const auto filterType = engineSettings.filterType == 0 ? Oversampling<float>::filterHalfBandFIREquiripple
+			: Oversampling<float>::filterHalfBandPolyphaseIIR;
+
+		return std::make_unique<Oversampling<float>>((size_t)jmax(1, numChannels),
+			(size_t)jlimit(0, maxFactorLog2, engineSettings.factorLog2), filterType, true, true);
+	}
+
+	/*Calls function with the stage at an index: 0 regSymm, 1 regAsymm, 2 aaSymm, 3 aaAsymm*/
+	template <class Function>
+	void withStage(int index, Function&& function)
+	{
+		switch (index)
+		{
+		case 0: function(regSymm); break;
+		case 1: function(regAsymm); break;
+		case 2: function(aaSymm); break;
+		default: function(aaAsymm); break;
+		}
+	}
+
+	/*Brings a dormant stage to the current distortion. Returns 1 if it had to be updated*/
+	int catchUp(int index)
+	{
+		if (stageDistortion[index] == distortionValue)
+			return 0;
+
+		withStage(index, [&](auto& s) { s.setDistortion(distortionValue); });
+		stageDistortion[index] = distortionValue;
+		return 1;
+	}
+
+	/*
+	Makes a stage the active one. After the first block it is reset and runs
+	muted for warmUpLength samples, then is faded in over crossfadeLength.
+	While the new stage is still muted, a further change replaces it and
+	leaves the stage being heard alone. Returns the number of stage
+	distortion updates made.
+	*/
+	int selectStage(int index)
+	{
+		const int previous = activeStage;
+		activeStage = index;
+		const int numUpdates = catchUp(index);
+
+		if (previous < 0)
+			return numUpdates;
+
+		const bool muted = fadeRemaining > crossfadeLength;
+		if (!muted)
+			fadingStage = previous;
+
+		// Back to the stage being heard before it was muted: it never stopped
+		if (index == fadingStage)
+		{
+			fadeRemaining = 0;
+			return numUpdates;
+		}
+
+		withStage(index, [](auto& s) { s.reset(); });
+		fadeRemaining = warmUpLength + crossfadeLength;
+		return numUpdates;
+	}
+
+	/*
+	Raised cosine crossfade of the outgoing stage in fadePointers into the
+	active stage in channelPointers, after warmUpLength samples of the
+	outgoing stage alone
+	*/
+	void crossfade(int numChannels, int numSamples)
+	{
+		const int done = warmUpLength + crossfadeLength - fadeRemaining;
+		const float step = MathConstants<float>::pi / (float)crossfadeLength;
+
+		for (int channel = 0; channel < numChannels; channel++)
+		{
+			float* active = channelPointers[channel];
+			const float* fading = fadePointers[channel];
+
+			for (int i = 0; i < numSamples; i++)
+			{
+				const int faded = done + i - warmUpLength;
+				const float gain = faded <= 0 ? 0.0f : 0.5f - 0.5f * std::cos(step * (float)faded);
+				active[i] = fading[i] + gain * (active[i] - fading[i]);
+			}
+		}
+
+		fadeRemaining -= numSamples;
+	}
+
+	Settings settings;
+	std::unique_ptr<Oversampling<float>> overSampling;
+	double distortionValue = 0.0;		// target of the active stage
+
+	// Nonlinearities
+	SymmetricStage regSymm;
+	AsymmetricStage regAsymm;
+	SymmetricStage aaSymm;
+	AsymmetricStage aaAsymm;
+
+	// Stage selection. A distortion of -1 marks a stage that has never been updated
+	int activeStage = -1;
+	int fadingStage = -1;
+	double stageDistortion[4] = { -1.0, -1.0, -1.0, -1.0 };
+
+	// Switch progress, warm-up then crossfade, in oversampled samples
+	int warmUpLength = 1;
+	int crossfadeLength = 1;
+	int fadeRemaining = 0;
+
+	// Outgoing stage's output during a switch
+	AudioBuffer<float> scratch;
+
+	// Channel pointers into the oversampled block and the scratch buffer
+	std::vector<float*> channelPointers;
+	std::vector<float*> fadePointers;
+};
+
+#endif // !TSClippingEngine_h
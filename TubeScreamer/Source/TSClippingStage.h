@@ -9,228 +9,1216 @@
 #ifndef TSClippingStage_h
 #define TSClippingStage_h
 #include "JuceHeader.h"
-#include "Matrices.h"
-#include "LagrangeInterp.h"
+#include "TS808Circuit.h"
+#include "TSClippingTable.h"
+#include "TSClippingTypes.h"
+#include "TSSolverStats.h"
+#include "TSTableCache.h"
+#include "TSTableRegistry.h"
+#include "TSTableSlot.h"
 #include <cmath>
+#include <vector>
 
 using namespace juce;
 using namespace dsp;
 
-template<class temp>
+template<class temp, template<class> class Clipping, int interpOrder = 3, class tableTemp = temp, class Circuit = TS808Circuit>
 
+/*
+Tube Screamer clipping stage.
+
+The diode model is a compile-time policy (see TSClippingTypes.h), so each
+clipping type compiles to its own branch-free solver and look-up table build.
+interpOrder (1, 3 or 5) sets the order of the look-up table interpolation.
+tableTemp is the sample type of the look-up tables, which can be narrower
+than temp: float tables with double state halve the table footprint and are
+accurate enough for the lookUp mode. The antiAliased mode needs double tables,
+as K is large and the anti-derivative difference cancels badly in float.
+Tables are always generated at the precision of temp.
+
+The circuit is a compile-time policy too (see TSCircuit.h), generated from a
+netlist by Tools/circuit_compiler.py, so pedal variants need no hand-written
+matrices; entries it makes zero are left out of the per-sample update.
+*/
 class TSClippingStage
 {
 public:
 
-	/*Enumerator class for setting the clipping type*/
-	enum class ClippingType
+	// Diode model
+	using ClippingType = Clipping<temp>;
+
+	/*Enumerator class for the processing mode used by processBlock*/
+	enum class ProcessMode
+	{
+		newton,			// regular process, solving the non-linearity directly
+		lookUp,			// regular process, using the look-up table
+		antiAliased,	// first order anti-derivative anti-aliasing
+		antiAliased2	// second order anti-derivative anti-aliasing, needs antiDerivativeOrder 2 tables
+	};
+
+	/*Enumerator class for the solver used when no look-up table is used*/
+	enum class Solver
 	{
-		symmetric,
-		asymmetric
+		cappedNewton,	// Newton iterations with steps capped at the transitional voltage
+		dampedNewton,	// Newton iterations with step halving while the residual grows
+		wrightOmega		// explicit Wright omega estimate and a fixed number of Newton steps
 	};
 
 	/*Constructor*/
-	TSClippingStage(ClippingType type)
+	TSClippingStage()
 	{
-		clippingType = type;
+		setNumChannels(1);
 	};
 
 
-	/*Set sample rate in Hz*/
+	/*Set sample rate in Hz. Precomputes the state space arrays over the distortion range*/
 	void setSampleRate(temp sampleRate)
 	{
 		fs = sampleRate;
+		buildStateSpaceGrid();
 	}
 
 	/*Set distortion amount of pedal*/
 	void setDistortion(temp distortion)
 	{
-		r2 = 51e3 + distortion* 500e3;
-		A[1][1] = -1.0f / (r2 * c2);
-		updateStateSpaceArrays();
+		distortionValue = distortion;
+		setCircuitDistortion(distortion);
+
+		if (stateSpaceGrid.empty())
+			updateStateSpaceArrays();
+		else
+			interpolateStateSpaceArrays();
+
+		if (tableKey.numSlices >= 4)
+		{
+			sliceWeights = Table::getSliceWeights((tableTemp)distortion, (size_t)tableKey.numSlices, tableKey.potRatio);
+			distortionVersion++;
+		}
 	}
 
-	/*Set diode parameters*/
+	/*
+	Set diode parameters. Tables made for the old values are no longer used;
+	call makeLookUpTable or requestLookUpTable to rebuild them.
+	*/
 	void setDiodeParameters(temp saturationCurrent, temp thermalVoltage, temp idealityFactor)
 	{
 		Is = saturationCurrent;
 		Vt = thermalVoltage;
 		Ni = idealityFactor;
+
+		tableKey.Is = (double)Is;
+		tableKey.Vt = (double)Vt;
+		tableKey.Ni = (double)Ni;
+
+		// the Newton cap depends on the diode
+		if (!stateSpaceGrid.empty())
+			buildStateSpaceGrid();
 	}
 
 	/*Updates state space arrays*/
 	void updateStateSpaceArrays()
 	{
-		temp AplusI[3][3];
+		Circuit::discretise(potEntry, fs, ss);
 
-		for (int i = 0; i < 3; i++)
+		// update Newton cap
+		cap = capFunc(ss.K_);
+	}
+
+	/*
+	Tabulates the discretised arrays and the Newton cap over the distortion
+	range for the current sample rate, so setDistortion only interpolates.
+
+	Distortion only moves one entry a of the continuous A, so by the
+	Sherman-Morrison formula every entry of Z = (2 fs I - A)^-1, and so of
+	A_ ... K_, is linear in t = a / (1 - a s), where s is Circuit::potCoupling.
+	Interpolating with weights taken in t is then exact up to rounding; only
+	the cap is approximated.
+	*/
+	void buildStateSpaceGrid()
+	{
+		stateSpaceGrid.resize((size_t)numStateSpacePoints * numStateSpaceValues);
+		stateSpaceT.resize((size_t)numStateSpacePoints);
+		stateSpaceS = Circuit::potCoupling(fs);
+
+		for (int k = 0; k < numStateSpacePoints; k++)
 		{
-			for (int j = 0; j < 3; j++)
-			{
-				if (i == j)
-					I[i][i] = 2.0f * fs;
-				else
-					I[i][j] = 0.0f;
+			setCircuitDistortion((temp)k / (temp)(numStateSpacePoints - 1));
+			updateStateSpaceArrays();
 
-				Z[i][j] = I[i][j] - A[i][j];
-				AplusI[i][j] = A[i][j] + I[i][j];
-			}
+			temp* point = &stateSpaceGrid[(size_t)k * numStateSpaceValues];
+			forEachStateSpaceValue([point](temp& value, int n) { point[n] = value; });
+			stateSpaceT[(size_t)k] = potEntry / ((temp)1.0 - potEntry * stateSpaceS);
 		}
 
-		// Matrix multiplications
-		matTool.invert3x3(Z);						// Z
-		matTool.multiply3x3by3x3(AplusI, Z, A_);	// A_
-		matTool.multiply3x3by3x1(Z, B, B_);			// B_
-		matTool.multiply3x3by3x1(Z, C, C_);			// C_
-		matTool.multiply1x3by3x3(D, Z, D_);			// D_
-		E_ = E + matTool.multiply1x3by3x1(D, B_);	// E_
-		F_ = matTool.multiply1x3by3x1(D, C_);		// F_
-		matTool.multiply1x3by3x3(G, Z, G_);			// G_
-		H_ = B_[1][0];								// H_
-		K_ = C_[1][0];								// K_		
-
-		// Scalar multiplication
+		setDistortion(distortionValue);
+	}
+
+	/*Sets the discretised arrays for the pot entry from the two nearest grid points*/
+	void interpolateStateSpaceArrays()
+	{
+		// Distortion outside 0 - 1 extrapolates from the end segments, still exactly
+		const int k = jlimit(0, numStateSpacePoints - 2, (int)(distortionValue * (temp)(numStateSpacePoints - 1)));
+		const temp t = potEntry / ((temp)1.0 - potEntry * stateSpaceS);
+		const temp w = (t - stateSpaceT[(size_t)k]) / (stateSpaceT[(size_t)k + 1] - stateSpaceT[(size_t)k]);
+
+		const temp* lo = &stateSpaceGrid[(size_t)k * numStateSpaceValues];
+		const temp* hi = lo + numStateSpaceValues;
+		forEachStateSpaceValue([lo, hi, w](temp& value, int n) { value = lo[n] + w * (hi[n] - lo[n]); });
+	}
+
+	/*Visits A_, B_, C_, D_, G_, E_, F_, H_, K_ and cap with their index in a grid point*/
+	template <class Visitor>
+	forcedinline void forEachStateSpaceValue(Visitor&& visit)
+	{
+		int n = 0;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				visit(ss.A_[i][j], n++);
+
 		for (int i = 0; i < 3; i++)
 		{
-			B_[i][0] *= 2.0f;
-			C_[i][0] *= 2.0f;
-			D_[i] *= 2.0f * fs;
-			G_[i] *= 2.0f * fs;
+			visit(ss.B_[i], n++);
+			visit(ss.C_[i], n++);
+			visit(ss.D_[i], n++);
+			visit(ss.G_[i], n++);
 		}
 
-		// update Newton cap
-		cap = capFunc(K_);
+		visit(ss.E_, n++);
+		visit(ss.F_, n++);
+		visit(ss.H_, n++);
+		visit(ss.K_, n++);
+		visit(cap, n++);
 	}
 
-	/*Generates an N size look-up table*/
-	void makeLookUpTable(size_t numPoints, temp sampleRate, temp pmax, temp distortion)
+	/*
+	Generates the look-up tables: numPoints uniformly spaced values of p
+	between -pmax and pmax, for each of numSlices distortion values between
+	0 and 1. Tables are loaded from TSTableCache when a matching one exists,
+	and written to it otherwise. Blocks until the tables are ready, so must
+	not be called while processing. antiDerivativeOrder 2 adds the second
+	anti-derivative needed by the antiAliased2 mode.
+	*/
+	void makeLookUpTable(size_t numPoints, temp sampleRate, temp pmax, size_t numSlices = 25, int antiDerivativeOrder = 1)
 	{
-		N = numPoints;
-		lagrangeInterp.setTableSize(N);
-		pLut = new temp[N];
-		iLut = new temp[N];
-		adLut = new temp[N];
+		setTableKey(sampleRate, pmax, numPoints, 0.0, numSlices, antiDerivativeOrder);
+		const uint64 request = tableSlot->newRequest();
+		tableSlot->publish(acquireTable(tableKey), request);
+	}
 
-		setSampleRate(sampleRate);
-		setDistortion(distortion);
+	/*
+	Same as makeLookUpTable, but sizes the table for a target interpolation
+	error in volts rather than a point count. The p range is found by driving
+	the circuit with full scale steps, and points are placed densely around
+	the diode knee and sparsely where i(p) is nearly linear.
+	*/
+	void makeBoundedLookUpTable(temp sampleRate, double maxError, size_t numSlices = 25, int antiDerivativeOrder = 1)
+	{
+		setTableKey(sampleRate, 0.0, 0, maxError, numSlices, antiDerivativeOrder);
+		const uint64 request = tableSlot->newRequest();
+		tableSlot->publish(acquireTable(tableKey), request);
+	}
 
-		temp dP = 2.0 * pmax / (temp)(N - 1);
-		temp p0 = -1.0 * pmax;
-		temp p1 = p0;
-		temp y = 0.0;
+	/*
+	Same as makeLookUpTable, but builds the tables on a background thread and
+	returns straight away. Until they are published, the lookUp and antiAliased
+	modes fall back to the Newton solver, so the stage keeps producing audio.
+	*/
+	void requestLookUpTable(size_t numPoints, temp sampleRate, temp pmax, size_t numSlices = 25, int antiDerivativeOrder = 1)
+	{
+		setTableKey(sampleRate, pmax, numPoints, 0.0, numSlices, antiDerivativeOrder);
+		buildInBackground();
+	}
 
-		// f(p) look-up table
-		for (int i = 0; i < N; i++)
+	/*Background version of makeBoundedLookUpTable*/
+	void requestBoundedLookUpTable(temp sampleRate, double maxError, size_t numSlices = 25, int antiDerivativeOrder = 1)
+	{
+		setTableKey(sampleRate, 0.0, 0, maxError, numSlices, antiDerivativeOrder);
+		buildInBackground();
+	}
+
+	/*True once tables matching the last make/requestLookUpTable call are in use*/
+	bool isLookUpTableReady() const
+	{
+		const auto published = tableSlot->get();
+		return published != nullptr && published->getKey() == tableKey;
+	}
+
+	/*Memory taken by the published look-up tables, in bytes*/
+	size_t getLookUpTableBytes() const
+	{
+		const auto published = tableSlot->get();
+		return published != nullptr ? published->getNumValues() * sizeof(tableTemp) : 0;
+	}
+
+	/*Largest interpolation error of the published tables along p, in volts*/
+	double getLookUpTableError() const
+	{
+		const auto published = tableSlot->get();
+		return published != nullptr ? published->getMeasuredError() : 0.0;
+	}
+
+	/*p range covered by the published tables*/
+	temp getLookUpTableRange() const
+	{
+		const auto published = tableSlot->get();
+		return published != nullptr ? (temp)published->getPMax() : (temp)0.0;
+	}
+
+	/*Sets the number of channels, each of which keeps its own state*/
+	void setNumChannels(int numChannels)
+	{
+		numChans = numChannels;
+		groups.assign((size_t)((numChannels + laneWidth - 1) / laneWidth), ChannelGroup());
+		frameIn.assign(groups.size() * laneWidth, 0.0);
+		frameOut.assign(groups.size() * laneWidth, 0.0);
+	}
+
+	/*Clears the state of every channel*/
+	void reset()
+	{
+		for (auto& g : groups)
+			g = ChannelGroup();
+	}
+
+	/*
+	Regular process - without any aliasing mitigation.
+	Processes one sample of every channel: in and out hold one sample per channel.
+	*/
+	void process(const temp* in, temp* out, bool useLut)
+	{
+		std::copy(in, in + numChans, frameIn.begin());
+		const bool hasTable = useLut && beginTableAccess();
+
+		for (size_t g = 0; g < groups.size(); g++)
 		{
-			p0 = -pmax + i * dP;
-			pLut[i] = p0;
-			y = cappedNewton(y, p0);
-			iLut[i] = (y - p0) / K_;
+			InputTerms t;
+			t.in = Lanes::fromRawArray(frameIn.data() + g * laneWidth);
+			computeInputTerms<1>(groups[g], &t, 1);
+			const Lanes y = hasTable ? processLanes<true>(groups[g], t) : processLanes<false>(groups[g], t);
+			y.copyToRawArray(frameOut.data() + g * laneWidth);
 		}
 
-		// Trapezoid Integration - ad(p) look-up table
-		temp ad = 0.0;
-		p1 = -pmax;
-		temp i0 = lagrangeInterp.lookUp(pLut, iLut, 0.0);
-		for (int i = 0; i < N; i++)
+		if (useLut)
+			endTableAccess();
+		std::copy(frameOut.begin(), frameOut.begin() + numChans, out);
+	}
+
+	/*
+	Process with first order anti-derivative anti-aliasing.
+	Processes one sample of every channel: in and out hold one sample per channel.
+	*/
+	void antiAliasedProcess(const temp* in, temp* out)
+	{
+		std::copy(in, in + numChans, frameIn.begin());
+		const bool hasTable = beginTableAccess();
+
+		for (size_t g = 0; g < groups.size(); g++)
 		{
-			iLut[i] -= i0;
+			InputTerms t;
+			t.in = Lanes::fromRawArray(frameIn.data() + g * laneWidth);
+			Lanes y;
+			if (hasTable)
+			{
+				computeInputTerms<2>(groups[g], &t, 1);
+				y = antiAliasedProcessLanes(groups[g], t);
+			}
+			else
+			{
+				computeInputTerms<1>(groups[g], &t, 1);
+				y = processLanes<false, true>(groups[g], t);
+			}
+			y.copyToRawArray(frameOut.data() + g * laneWidth);
+		}
+
+		endTableAccess();
+		std::copy(frameOut.begin(), frameOut.begin() + numChans, out);
+	}
+
+	/*Sets the mode used by processBlock*/
+	void setProcessMode(ProcessMode mode)
+	{
+		processMode = mode;
+	}
+
+	/*Sets the solver used by the newton mode, and by the other modes until their tables are ready*/
+	void setSolver(Solver newSolver)
+	{
+		solver = newSolver;
+	}
+
+	/*Processes a block of a single channel, in place if in == out*/
+	template <class SampleType>
+	void processBlock(const SampleType* in, SampleType* out, int numSamples)
+	{
+		processBlock(&in, &out, 1, numSamples);
+	}
+
+	/*
+	Processes a block of several channels, in place if in == out.
+	The mode is chosen once per block and the per-sample loop is specialised for it.
+	*/
+	template <class SampleType>
+	void processBlock(const SampleType* const* in, SampleType* const* out, int numChannels, int numSamples)
+	{
+		jassert(numChannels <= numChans);
+		solverCounts = TSSolverCounts();
 
-			if (i > 0)
-				ad += 0.5 * dP * (iLut[i] + iLut[i - 1]);
-			adLut[i] = ad;
+		if (processMode == ProcessMode::newton)
+		{
+			processGroups<ProcessMode::newton, false>(in, out, numChannels, numSamples);
+			return;
 		}
 
-		// Adjust offset
-		temp ad0 = lagrangeInterp.lookUp(pLut, adLut, 0.0);
-		for (int i = 0; i < N; i++)
+		const bool hasTable = beginTableAccess();
+
+		if (processMode == ProcessMode::lookUp)
+		{
+			if (hasTable)
+				processGroups<ProcessMode::lookUp, true>(in, out, numChannels, numSamples);
+			else
+				processGroups<ProcessMode::lookUp, false>(in, out, numChannels, numSamples);
+		}
+		else if (processMode == ProcessMode::antiAliased2)
+		{
+			if (hasTable && table->getNumKinds() > 2)
+				processGroups<ProcessMode::antiAliased2, true>(in, out, numChannels, numSamples);
+			else
+				processGroups<ProcessMode::antiAliased2, false>(in, out, numChannels, numSamples);
+		}
+		else
 		{
-			adLut[i] -= ad0;
+			if (hasTable)
+				processGroups<ProcessMode::antiAliased, true>(in, out, numChannels, numSamples);
+			else
+				processGroups<ProcessMode::antiAliased, false>(in, out, numChannels, numSamples);
 		}
 
+		endTableAccess();
 	}
 
-	/*Regular process - without any aliasing mitigation*/
-	temp process(temp in, bool useLut)
+	/*Solver work done by the last processBlock call, for the thread that called it*/
+	const TSSolverCounts& getBlockSolverCounts() const
 	{
-		// Input
-		const temp p = matTool.multiply1x3by3x1(G_, x) + H_ * in;
+		return solverCounts;
+	}
 
-		// Solve non-linearity
-		temp iv = 0.0;
-		if (useLut)
+	private:
+	// SIMD register holding one sample of several channels
+	using Lanes = SIMDRegister<temp>;
+	static constexpr int laneWidth = (int)Lanes::SIMDNumElements;
+
+	// look-up tables, shared by every stage with the same key
+	using Table = TSClippingTable<tableTemp, interpOrder>;
+	using Interp = typename Table::Interp;
+	using Registry = TSTableRegistry<Table>;
+
+	/*State of one SIMD register's worth of channels*/
+	struct ChannelGroup
+	{
+		Lanes x[3] = { Lanes::expand(0.0), Lanes::expand(0.0), Lanes::expand(0.0) };
+		Lanes xPrev[3] = { Lanes::expand(0.0), Lanes::expand(0.0), Lanes::expand(0.0) };
+		Lanes x2Prev[3] = { Lanes::expand(0.0), Lanes::expand(0.0), Lanes::expand(0.0) };
+
+		Lanes x3Prev[3] = { Lanes::expand(0.0), Lanes::expand(0.0), Lanes::expand(0.0) };
+
+		// anti-derivs
+		Lanes adPrev = Lanes::expand(0.0);
+		Lanes pPrev = Lanes::expand(0.0);
+		Lanes inPrev = Lanes::expand(0.0);
+
+		// second order anti-derivs
+		Lanes ad2Prev = Lanes::expand(0.0);
+		Lanes ad2Prev2 = Lanes::expand(0.0);
+		Lanes p2Prev = Lanes::expand(0.0);
+		Lanes in2Prev = Lanes::expand(0.0);
+
+		// distortion the first and second order anti-derivative states were computed with
+		uint32 version = 0;
+		uint32 version2 = 0;
+	};
+
+	/*
+	Input-only terms of one step, computed ahead of the serial recurrence.
+	u is the input, or in the anti-aliased modes the input averaged with the
+	same weights as the states.
+	*/
+	struct InputTerms
+	{
+		Lanes in;		// input, kept for the anti-aliased history
+		Lanes p;		// H_ in
+		Lanes x[3];		// B_ u
+		Lanes y;		// E_ u
+	};
+
+	// samples whose input terms are computed together, ahead of the recurrence
+	static constexpr int chunkSize = 64;
+
+	/*
+	Runs one mode over a block, one channel group at a time.
+	Without a table, lookUp and antiAliased run the Newton solver instead.
+
+	Each chunk is done in three passes: gather the inputs and compute their
+	terms, which has no dependence between samples; run the recurrence, which
+	is left with only the state feedback and the non-linearity; scatter the
+	outputs. Inputs are read before outputs are written, so in may equal out.
+	*/
+	template <ProcessMode mode, bool hasTable, class SampleType>
+	void processGroups(const SampleType* const* in, SampleType* const* out, int numChannels, int numSamples)
+	{
+		constexpr int divisor = mode == ProcessMode::antiAliased && hasTable ? 2 : mode == ProcessMode::antiAliased2 && hasTable ? 4 : 1;
+
+		InputTerms terms[chunkSize];
+		Lanes results[chunkSize];
+		alignas(Lanes::SIMDRegisterSize) temp frame[laneWidth] = {};
+		alignas(Lanes::SIMDRegisterSize) temp result[laneWidth];
+
+		for (int first = 0; first < numChannels; first += laneWidth)
 		{
-			iv = lagrangeInterp.lookUp(pLut, iLut, p);
+			const int lanes = jmin(laneWidth, numChannels - first);
+			ChannelGroup g = groups[(size_t)(first / laneWidth)];
+
+			for (int start = 0; start < numSamples; start += chunkSize)
+			{
+				const int n = jmin(chunkSize, numSamples - start);
+
+				for (int k = 0; k < n; k++)
+				{
+					for (int l = 0; l < lanes; l++)
+						frame[l] = (temp)in[first + l][start + k];
+					terms[k].in = Lanes::fromRawArray(frame);
+				}
+				computeInputTerms<divisor>(g, terms, n);
+
+				for (int k = 0; k < n; k++)
+				{
+					if (mode == ProcessMode::antiAliased && hasTable)
+						results[k] = antiAliasedProcessLanes(g, terms[k], lanes);
+					else if (mode == ProcessMode::antiAliased2 && hasTable)
+						results[k] = antiAliased2ProcessLanes(g, terms[k], lanes);
+					else
+						results[k] = processLanes<mode == ProcessMode::lookUp && hasTable, mode == ProcessMode::antiAliased || mode == ProcessMode::antiAliased2>(g, terms[k], lanes);
+				}
+
+				for (int k = 0; k < n; k++)
+				{
+					results[k].copyToRawArray(result);
+					for (int l = 0; l < lanes; l++)
+						out[first + l][start + k] = (SampleType)result[l];
+				}
+			}
+
+			groups[(size_t)(first / laneWidth)] = g;
 		}
-		else
+	}
+
+	/*
+	Fills in the terms of n steps from their inputs, terms[k].in. The inputs
+	before the first come from the group's history, so chunks join up.
+	divisor is 1 for the regular process, 2 and 4 for the anti-aliased modes.
+	*/
+	template <int divisor>
+	forcedinline void computeInputTerms(const ChannelGroup& g, InputTerms* terms, int n)
+	{
+		Lanes prev = g.inPrev;
+		Lanes prev2 = g.in2Prev;
+
+		for (int k = 0; k < n; k++)
 		{
-			v = newIterate(p);
-			v = cappedNewton(v, p);
-			iv = (v - p) / K_;
+			InputTerms& t = terms[k];
+			Lanes u = t.in;
+			if (divisor == 2)
+				u = (t.in + prev) * (temp)0.5;
+			else if (divisor == 4)
+				u = (t.in + prev * (temp)2.0 + prev2) * (temp)0.25;
+			prev2 = prev;
+			prev = t.in;
+
+			t.p = t.in * ss.H_;
+			for (int i = 0; i < 3; i++)
+				if ((Circuit::inputMask & (1 << i)) != 0)
+					t.x[i] = u * ss.B_[i];
+			t.y = u * ss.E_;
 		}
+	}
 
-		// State update
-		temp xTemp[3][1];
-		matTool.multiply3x3by3x1(A_, xPrev, xTemp);
-		for (int i = 0; i < 3; i++)
+	/*
+	Sum of x[j] * c[j] over the j set in mask. The masks come from the
+	circuit, so entries that are zero for every rate and distortion cost
+	nothing, and the terms are added in the same order as the full sum.
+	*/
+	template <int mask>
+	static forcedinline Lanes dot(const Lanes* x, const Vec3<temp>& c)
+	{
+		if (mask == 0)
+			return Lanes::expand((temp)0.0);
+
+		const int first = (mask & 1) != 0 ? 0 : (mask & 2) != 0 ? 1 : 2;
+		Lanes sum = x[first] * c[first];
+		if ((mask & 2) != 0 && first < 1)
+			sum += x[1] * c[1];
+		if ((mask & 4) != 0 && first < 2)
+			sum += x[2] * c[2];
+		return sum;
+	}
+
+	/*Diode voltage without the current term, p = G_ x + H_ in*/
+	forcedinline Lanes diodeVoltage(const Lanes* x, const InputTerms& t)
+	{
+		return dot<Circuit::voltageMask>(x, ss.G_) + t.p;
+	}
+
+	/*
+	State i after a step, A_ x / divisor + B_ u + C_ iv. The anti-aliased
+	modes pass the sum of 2 or 4 weighted states as x.
+	*/
+	template <int i, int divisor>
+	forcedinline Lanes nextState(const Lanes* x, const InputTerms& t, Lanes iv)
+	{
+		Lanes next = dot<Circuit::stateMask(i)>(x, ss.A_[i]);
+		if (divisor != 1)
+			next = next * ((temp)1.0 / (temp)divisor);
+		if ((Circuit::inputMask & (1 << i)) != 0)
+			next = next + t.x[i];
+		if ((Circuit::currentMask & (1 << i)) != 0)
+			next = next + iv * ss.C_[i];
+		return next;
+	}
+
+	/*Output of a step, D_ x / divisor + E_ u + F_ iv*/
+	template <int divisor>
+	forcedinline Lanes stepOutput(const Lanes* x, const InputTerms& t, Lanes iv)
+	{
+		Lanes out = dot<Circuit::outputMask>(x, ss.D_);
+		if (divisor != 1)
+			out = out * ((temp)1.0 / (temp)divisor);
+		return out + t.y + iv * ss.F_;
+	}
+
+	/*
+	Regular process of one channel group. keepHistory also keeps the
+	anti-aliased state up to date, for when it stands in for antiAliasedProcessLanes.
+	*/
+	template <bool useLut, bool keepHistory = false>
+	forcedinline Lanes processLanes(ChannelGroup& g, const InputTerms& t, int activeLanes = laneWidth)
+	{
+		// Input
+		const Lanes p = diodeVoltage(g.x, t);
+
+		// Solve non-linearity, lane by lane
+		alignas(Lanes::SIMDRegisterSize) temp pl[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp il[laneWidth] = {};
+		p.copyToRawArray(pl);
+
+		for (int l = 0; l < activeLanes; l++)
 		{
-			x[i][0] = xTemp[i][0] + (B_[i][0] * in) + (C_[i][0] * iv);
+			if (useLut)
+			{
+				il[l] = (temp)table->lookUp(Table::Kind::current, sliceWeights, (tableTemp)pl[l]);
+			}
+			else
+			{
+				il[l] = (solve(pl[l]) - pl[l]) / ss.K_;
+			}
 		}
+		const Lanes iv = Lanes::fromRawArray(il);
+
+		// State update
+		g.x[0] = nextState<0, 1>(g.xPrev, t, iv);
+		g.x[1] = nextState<1, 1>(g.xPrev, t, iv);
+		g.x[2] = nextState<2, 1>(g.xPrev, t, iv);
 
 		// Calculate output
-		float out = matTool.multiply1x3by3x1(D_, xPrev) + E_ * in + F_ * iv;
+		const Lanes out = stepOutput<1>(g.xPrev, t, iv);
+
+		if (keepHistory)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				g.x3Prev[i] = g.x2Prev[i];
+				g.x2Prev[i] = g.xPrev[i];
+			}
+			g.in2Prev = g.inPrev;
+			g.inPrev = t.in;
+			g.p2Prev = g.pPrev;
+			g.pPrev = p;
+
+			// the anti-derivatives are re-evaluated once a table arrives
+			g.version = distortionVersion - 1;
+			g.version2 = distortionVersion - 1;
+		}
+
+		for (int i = 0; i < 3; i++)
+			g.xPrev[i] = g.x[i];
 
-		matTool.copyTo(xPrev, x);
 		return out;
 	}
 
-	/*Process with first order anti-derivative anti-aliasing*/
-	temp antiAliasedProcess(temp in)
+	/*First order anti-derivative anti-aliased process of one channel group*/
+	forcedinline Lanes antiAliasedProcessLanes(ChannelGroup& g, const InputTerms& t, int activeLanes = laneWidth)
 	{
 		// Input
-		const temp p = matTool.multiply1x3by3x1(G_, x) + H_ * in;
-		temp iv = 0.0;
-		temp ad = lagrangeInterp.lookUp(pLut, adLut, p);
+		const Lanes p = diodeVoltage(g.x, t);
+
+		// Anti-derivative difference, lane by lane
+		alignas(Lanes::SIMDRegisterSize) temp pl[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp ppl[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp adpl[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp adl[laneWidth] = {};
+		alignas(Lanes::SIMDRegisterSize) temp il[laneWidth] = {};
+		p.copyToRawArray(pl);
+		g.pPrev.copyToRawArray(ppl);
+		g.adPrev.copyToRawArray(adpl);
+
+		// Re-evaluate the previous anti-derivative if the distortion has moved,
+		// so the difference below never mixes two slices of the table
+		if (g.version != distortionVersion)
+		{
+			for (int l = 0; l < activeLanes; l++)
+				adpl[l] = (temp)table->lookUp(Table::Kind::antiDerivative, sliceWeights, (tableTemp)ppl[l]);
+			g.version = distortionVersion;
+		}
 
+		for (int l = 0; l < activeLanes; l++)
+		{
+			adl[l] = (temp)table->lookUp(Table::Kind::antiDerivative, sliceWeights, (tableTemp)pl[l]);
 
-		if (fabsf(p - pPrev) > 1.0e-8)
-			iv = (ad - adPrev) / (p - pPrev);
-		else
-			iv = lagrangeInterp.lookUp(pLut, iLut, 0.5 * (p + pPrev));
+			if (fabs(pl[l] - ppl[l]) > 1.0e-8)
+				il[l] = (adl[l] - adpl[l]) / (pl[l] - ppl[l]);
+			else
+				il[l] = (temp)table->lookUp(Table::Kind::current, sliceWeights, (tableTemp)(0.5 * (pl[l] + ppl[l])));
+		}
+		const Lanes ad = Lanes::fromRawArray(adl);
+		const Lanes iv = Lanes::fromRawArray(il);
 
 		// update state variable
-		temp xCombined[3][1] = { {0.0}, {0.0}, {0.0} };
-		matTool.add3x1s(xCombined, xPrev);
-		matTool.add3x1s(xCombined, x2Prev);
-		temp inCombined = 0.5 * (in + inPrev);
+		Lanes xCombined[3];
+		for (int i = 0; i < 3; i++)
+			xCombined[i] = g.xPrev[i] + g.x2Prev[i];
 
+		g.x[0] = nextState<0, 2>(xCombined, t, iv);
+		g.x[1] = nextState<1, 2>(xCombined, t, iv);
+		g.x[2] = nextState<2, 2>(xCombined, t, iv);
+
+		// output
+		const Lanes out = stepOutput<2>(xCombined, t, iv);
 
-		temp xTemp[3][1];
-		matTool.multiply3x3by3x1(A_, xCombined, xTemp);
 		for (int i = 0; i < 3; i++)
 		{
-			x[i][0] = 0.5 * xTemp[i][0] + (B_[i][0] * inCombined) + (C_[i][0] * iv);
+			g.x3Prev[i] = g.x2Prev[i];
+			g.x2Prev[i] = g.xPrev[i];
+			g.xPrev[i] = g.x[i];
 		}
+		g.in2Prev = g.inPrev;
+		g.inPrev = t.in;
+		g.p2Prev = g.pPrev;
+		g.pPrev = p;
+		g.adPrev = ad;
+		g.version2 = distortionVersion - 1;
+		return out;
+	}
 
-		// output
-		temp out = 0.5 * matTool.multiply1x3by3x1(D_, xCombined) + E_ * inCombined + F_ * iv;
+	/*
+	Second order anti-derivative anti-aliased process of one channel group.
+	The non-linearity is averaged over the last three values of p with a
+	triangular kernel, which delays it by one sample, so the states and input
+	of the linear part are averaged with the same 1/4, 1/2, 1/4 weights.
+	*/
+	forcedinline Lanes antiAliased2ProcessLanes(ChannelGroup& g, const InputTerms& t, int activeLanes = laneWidth)
+	{
+		// Input
+		const Lanes p = diodeVoltage(g.x, t);
+
+		// Second anti-derivative differences, lane by lane
+		alignas(Lanes::SIMDRegisterSize) temp pl[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp p1l[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp p2l[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp f1l[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp f2l[laneWidth];
+		alignas(Lanes::SIMDRegisterSize) temp fl[laneWidth] = {};
+		alignas(Lanes::SIMDRegisterSize) temp il[laneWidth] = {};
+		p.copyToRawArray(pl);
+		g.pPrev.copyToRawArray(p1l);
+		g.p2Prev.copyToRawArray(p2l);
+		g.ad2Prev.copyToRawArray(f1l);
+		g.ad2Prev2.copyToRawArray(f2l);
+
+		// Re-evaluate the previous anti-derivatives if the distortion has moved
+		if (g.version2 != distortionVersion)
+		{
+			for (int l = 0; l < activeLanes; l++)
+			{
+				f1l[l] = (temp)table->lookUp(Table::Kind::antiDerivative2, sliceWeights, (tableTemp)p1l[l]);
+				f2l[l] = (temp)table->lookUp(Table::Kind::antiDerivative2, sliceWeights, (tableTemp)p2l[l]);
+			}
+			g.version2 = distortionVersion;
+		}
+
+		for (int l = 0; l < activeLanes; l++)
+		{
+			fl[l] = (temp)table->lookUp(Table::Kind::antiDerivative2, sliceWeights, (tableTemp)pl[l]);
+			il[l] = secondOrderDifference(pl[l], p1l[l], p2l[l], fl[l], f1l[l], f2l[l]);
+		}
+		const Lanes iv = Lanes::fromRawArray(il);
+
+		// update state variable
+		Lanes xCombined[3];
+		for (int i = 0; i < 3; i++)
+			xCombined[i] = g.xPrev[i] + g.x2Prev[i] * (temp)2.0 + g.x3Prev[i];
 
+		g.x[0] = nextState<0, 4>(xCombined, t, iv);
+		g.x[1] = nextState<1, 4>(xCombined, t, iv);
+		g.x[2] = nextState<2, 4>(xCombined, t, iv);
 
-		matTool.copyTo(x2Prev, xPrev);
-		matTool.copyTo(xPrev, x);
-		inPrev = in;
-		pPrev = p;
-		adPrev = ad;
+		// output
+		const Lanes out = stepOutput<4>(xCombined, t, iv);
+
+		for (int i = 0; i < 3; i++)
+		{
+			g.x3Prev[i] = g.x2Prev[i];
+			g.x2Prev[i] = g.xPrev[i];
+			g.xPrev[i] = g.x[i];
+		}
+		g.in2Prev = g.inPrev;
+		g.inPrev = t.in;
+		g.p2Prev = g.pPrev;
+		g.pPrev = p;
+		g.ad2Prev2 = g.ad2Prev;
+		g.ad2Prev = Lanes::fromRawArray(fl);
+		g.version = distortionVersion - 1;
 		return out;
 	}
 
-	/*Sets the clipping type*/
-	void setClippingType(ClippingType type)
+	/*
+	Second order anti-derivative difference of p0 (newest), p1 and p2, with
+	f0, f1 and f2 the values of ad2 there. When p0 and p2 nearly coincide the
+	difference is expanded about their mean instead, and close pairs of points
+	use ad or i at their midpoint, so there is no division by a tiny step.
+	*/
+	forcedinline temp secondOrderDifference(temp p0, temp p1, temp p2, temp f0, temp f1, temp f2)
 	{
-		clippingType = type;
+		const temp span = p0 - p2;
+		if (fabs(span) > adaa2Threshold)
+			return (temp)2.0 * (firstOrderDifference(p0, p1, f0, f1) - firstOrderDifference(p1, p2, f1, f2)) / span;
+
+		const temp mean = (temp)0.5 * (p0 + p2);
+		const temp delta = mean - p1;
+		if (fabs(delta) > adaa2Threshold)
+		{
+			const temp adMean = (temp)table->lookUp(Table::Kind::antiDerivative, sliceWeights, (tableTemp)mean);
+			const temp ad2Mean = (temp)table->lookUp(Table::Kind::antiDerivative2, sliceWeights, (tableTemp)mean);
+			return (temp)2.0 / delta * (adMean + (f1 - ad2Mean) / delta);
+		}
+
+		return (temp)table->lookUp(Table::Kind::current, sliceWeights, (tableTemp)(0.5 * (mean + p1)));
+	}
+
+	/*(f0 - f1) / (p0 - p1), or ad at the midpoint when p0 and p1 are close*/
+	forcedinline temp firstOrderDifference(temp p0, temp p1, temp f0, temp f1)
+	{
+		if (fabs(p0 - p1) > adaa2Threshold)
+			return (f0 - f1) / (p0 - p1);
+
+		return (temp)table->lookUp(Table::Kind::antiDerivative, sliceWeights, (tableTemp)(0.5 * (p0 + p1)));
+	}
+
+	/*Sets the key of the tables used by lookUp and antiAliased processing*/
+	void setTableKey(temp sampleRate, temp pmax, size_t numPoints, double maxError, size_t numSlices, int antiDerivativeOrder)
+	{
+		setSampleRate(sampleRate);
+
+		tableKey = typename Table::Key();
+		tableKey.clippingType = ClippingType::id;
+		tableKey.circuit = Circuit::id;
+		tableKey.potRatio = potRatio;
+		tableKey.sampleRate = (double)sampleRate;
+		tableKey.pmax = (double)pmax;
+		tableKey.numPoints = (int64)numPoints;
+		tableKey.maxError = maxError;
+		tableKey.numSlices = (int64)numSlices;
+		tableKey.antiDerivativeOrder = (int64)antiDerivativeOrder;
+		tableKey.Is = (double)Is;
+		tableKey.Vt = (double)Vt;
+		tableKey.Ni = (double)Ni;
+
+		setDistortion(distortionValue);
+	}
+
+	/*Builds the tables for the current key on the shared background thread*/
+	void buildInBackground()
+	{
+		const uint64 request = tableSlot->newRequest();
+		tableSlot->collectGarbage();
+
+		if (buildPool == nullptr)
+			buildPool = std::make_unique<SharedResourcePointer<TSTableBuildPool>>();
+
+		// The job only holds the slot, so the stage may be destroyed before it runs
+		auto slot = tableSlot;
+		const auto key = tableKey;
+		(*buildPool)->addJob([slot, key, request]
+		{
+			TSClippingStage builder;
+			builder.setDiodeParameters((temp)key.Is, (temp)key.Vt, (temp)key.Ni);
+			builder.setSampleRate((temp)key.sampleRate);
+			slot->publish(builder.acquireTable(key), request);
+		});
+	}
+
+	/*
+	Returns the shared tables for a key, building them with this stage's solver
+	if no other stage holds them. Stages with the same key share one table,
+	which is freed with its last user.
+	*/
+	std::shared_ptr<const Table> acquireTable(const typename Table::Key& key)
+	{
+		const temp currentDistortion = distortionValue;
+
+		auto shared = Registry::acquire(key, [&](Table& newTable)
+		{
+			// Tables only depend on the key, so reuse one built by an earlier run
+			if (!TSTableCache::load(newTable, key))
+			{
+				buildTable(newTable, key);
+				TSTableCache::save(newTable);
+			}
+		});
+
+		setDistortion(currentDistortion);
+		return shared;
+	}
+
+	/*
+	Pins the published table for the block, if it matches the current key.
+	Must be paired with endTableAccess.
+	*/
+	bool beginTableAccess()
+	{
+		const Table* published = tableSlot->enter();
+		table = (published != nullptr && published->getKey() == tableKey) ? published : nullptr;
+		return table != nullptr;
+	}
+
+	void endTableAccess()
+	{
+		table = nullptr;
+		tableSlot->exit();
+	}
+
+	/*
+	Generates every slice of a table for the current circuit parameters.
+	For each p bucket, i(p) is solved at the bucket's nodes, and ad(p) and
+	ad2(p) are integrated between them with 3-point Gauss-Legendre quadrature.
+	The buckets are then chained so that ad and ad2 are continuous, with
+	ad(0) = ad2(0) = 0.
+	*/
+	void buildTable(Table& newTable, const typename Table::Key& key)
+	{
+		const size_t numSlices = (size_t)key.numSlices;
+		const temp range = key.pmax > 0.0 ? (temp)key.pmax : findPRange(numSlices);
+		const std::vector<int> cells = key.maxError > 0.0 ? chooseLayout(range, key.maxError, numSlices, key.antiDerivativeOrder > 1)
+			: std::vector<int>(1, (int)key.numPoints - 1);
+
+		newTable.allocate(key, range, cells);
+		const Interp& grid = newTable.getGrid();
+		const int numBuckets = grid.getNumBuckets();
+		const int g = Interp::numGhostNodes;
+		const bool hasAd2 = key.antiDerivativeOrder > 1;
+
+		std::vector<std::vector<double>> iNodes((size_t)numBuckets), adNodes((size_t)numBuckets), ad2Nodes((size_t)numBuckets);
+		double worstError = 0.0;
+
+		for (size_t slice = 0; slice < numSlices; slice++)
+		{
+			setDistortion(newTable.getSliceDistortion(slice));
+			temp y = 0.0;
+			const double i0 = solveCurrent(0.0, 0.0, y);
+
+			// ad and ad2 relative to each bucket's first node, then shifted to be continuous.
+			// Adding c to ad adds c (p - first node) to ad2.
+			double edgeAd = 0.0, edgeAd2 = 0.0, ad0 = 0.0, ad20 = 0.0;
+			for (int b = 0; b < numBuckets; b++)
+			{
+				evaluateBucket(grid, b, i0, iNodes[(size_t)b], adNodes[(size_t)b], ad2Nodes[(size_t)b]);
+
+				auto& ad = adNodes[(size_t)b];
+				auto& ad2 = ad2Nodes[(size_t)b];
+				const double first = grid.getNode(b, 0);
+				const double shift = edgeAd - ad[(size_t)g];
+				const double shift2 = edgeAd2 - ad2[(size_t)g] - shift * (grid.getNode(b, g) - first);
+				for (size_t k = 0; k < ad.size(); k++)
+				{
+					ad2[k] += shift2 + shift * (grid.getNode(b, (int)k) - first);
+					ad[k] += shift;
+				}
+				edgeAd = ad[(size_t)(g + grid.getBucketCells(b))];
+				edgeAd2 = ad2[(size_t)(g + grid.getBucketCells(b))];
+
+				// anti-derivatives at p = 0, from the nearest node below it
+				const double left = grid.getNode(b, g);
+				const double right = grid.getNode(b, g + grid.getBucketCells(b));
+				if (left <= 0.0 && 0.0 < right)
+				{
+					const int k = g + (int)std::floor(-left / (grid.getNode(b, g + 1) - left));
+					const double pk = grid.getNode(b, k);
+					double moment;
+					y = newIterate((temp)pk);
+					ad0 = ad[(size_t)k] + integrateCurrent(pk, 0.0, i0, y, &moment);
+					ad20 = ad2[(size_t)k] - pk * ad[(size_t)k] + moment;
+				}
+			}
+
+			for (int b = 0; b < numBuckets; b++)
+			{
+				auto& ad = adNodes[(size_t)b];
+				auto& ad2 = ad2Nodes[(size_t)b];
+				for (size_t k = 0; k < ad.size(); k++)
+				{
+					ad2[k] -= ad20 + ad0 * grid.getNode(b, (int)k);
+					ad[k] -= ad0;
+				}
+
+				grid.makeBucketCoefficients(b, iNodes[(size_t)b].data(), newTable.getCoefficients(Table::Kind::current, slice));
+				grid.makeBucketCoefficients(b, ad.data(), newTable.getCoefficients(Table::Kind::antiDerivative, slice));
+				if (hasAd2)
+					grid.makeBucketCoefficients(b, ad2.data(), newTable.getCoefficients(Table::Kind::antiDerivative2, slice));
+			}
+
+			worstError = jmax(worstError, measureSliceError(grid, newTable.getCoefficients(Table::Kind::current, slice),
+				newTable.getCoefficients(Table::Kind::antiDerivative, slice),
+				hasAd2 ? newTable.getCoefficients(Table::Kind::antiDerivative2, slice) : nullptr,
+				iNodes, adNodes, ad2Nodes, i0));
+		}
+
+		newTable.setMeasuredError(worstError);
+	}
+
+	/*
+	Picks the cells of each p bucket, doubling them until the interpolation
+	error of every slice is below maxError, including the error of ad2 if
+	withAd2 is set. Doubling stops early at
+	maxCellsPerBucket, or once a fine bucket no longer halves its error,
+	which means the rounding of tableTemp has been reached.
+	*/
+	std::vector<int> chooseLayout(temp range, double maxError, size_t numSlices, bool withAd2)
+	{
+		std::vector<int> cells((size_t)numBuckets, 1);
+		const double bucketWidth = 2.0 * (double)range / numBuckets;
+
+		for (size_t slice = 0; slice < numSlices; slice++)
+		{
+			setDistortion(Table::getSliceDistortion(slice, numSlices, potRatio));
+			temp y = 0.0;
+			const double i0 = solveCurrent(0.0, 0.0, y);
+
+			for (int b = 0; b < numBuckets; b++)
+			{
+				const temp left = (temp)(-(double)range + bucketWidth * b);
+				double previousError = std::numeric_limits<double>::max();
+
+				while (cells[(size_t)b] < maxCellsPerBucket)
+				{
+					Interp bucket;
+					bucket.setLayout(left, (temp)(left + bucketWidth), std::vector<int>(1, cells[(size_t)b]));
+
+					std::vector<std::vector<double>> iNodes(1), adNodes(1), ad2Nodes(1);
+					evaluateBucket(bucket, 0, i0, iNodes[0], adNodes[0], ad2Nodes[0]);
+
+					std::vector<tableTemp> iCoeffs(bucket.getNumCoefficients()), adCoeffs(iCoeffs.size()), ad2Coeffs(iCoeffs.size());
+					bucket.makeBucketCoefficients(0, iNodes[0].data(), iCoeffs.data());
+					bucket.makeBucketCoefficients(0, adNodes[0].data(), adCoeffs.data());
+					bucket.makeBucketCoefficients(0, ad2Nodes[0].data(), ad2Coeffs.data());
+
+					const double error = measureSliceError(bucket, iCoeffs.data(), adCoeffs.data(), withAd2 ? ad2Coeffs.data() : nullptr,
+						iNodes, adNodes, ad2Nodes, i0);
+					if (error <= maxError)
+						break;
+
+					if (cells[(size_t)b] >= 16 && error > 0.5 * previousError)
+					{
+						cells[(size_t)b] /= 2;
+						break;
+					}
+
+					previousError = error;
+					cells[(size_t)b] *= 2;
+				}
+			}
+		}
+
+		return cells;
+	}
+
+	/*
+	Largest |p| reached over every slice when the input steps between
+	-inputPeak and inputPeak at a few rates, with some headroom.
+	*/
+	temp findPRange(size_t numSlices)
+	{
+		const temp inputPeak = 1.0;
+		temp largest = 0.0;
+
+		for (size_t slice = 0; slice < numSlices; slice++)
+		{
+			setDistortion(Table::getSliceDistortion(slice, numSlices, potRatio));
+
+			for (temp frequency : { (temp)30.0, (temp)300.0, (temp)3000.0 })
+			{
+				ChannelGroup g;
+				const int halfPeriod = jmax(1, (int)(fs / (2.0 * frequency)));
+
+				for (int i = 0; i < 4 * halfPeriod; i++)
+				{
+					InputTerms t;
+					t.in = Lanes::expand((i / halfPeriod) % 2 == 0 ? inputPeak : -inputPeak);
+					computeInputTerms<1>(g, &t, 1);
+					const Lanes p = diodeVoltage(g.x, t);
+					largest = jmax(largest, (temp)std::abs(p.get(0)));
+					processLanes<false>(g, t, 1);
+				}
+			}
+		}
+
+		return (temp)std::ceil(1.25 * largest);
+	}
+
+	/*Solves i(p) - i0 for the current distortion, starting Newton from y (updated)*/
+	double solveCurrent(double p, double i0, temp& y)
+	{
+		y = cappedNewton(y, (temp)p);
+		return ((double)y - p) / (double)ss.K_ - i0;
+	}
+
+	/*
+	Integral of i(p) - i0 from a to b, with 3-point Gauss-Legendre quadrature.
+	If moment is given it receives the integral of (b - p)(i(p) - i0), which is
+	what ad2 gains over the interval on top of (b - a) ad(a).
+	*/
+	double integrateCurrent(double a, double b, double i0, temp& y, double* moment = nullptr)
+	{
+		const double mid = 0.5 * (a + b);
+		const double half = 0.5 * (b - a);
+		const double offset = half * std::sqrt(0.6);
+
+		const double i1 = solveCurrent(mid - offset, i0, y);
+		const double i2 = solveCurrent(mid, i0, y);
+		const double i3 = solveCurrent(mid + offset, i0, y);
+
+		if (moment != nullptr)
+			*moment = half * (5.0 * (half + offset) * i1 + 8.0 * half * i2 + 5.0 * (half - offset) * i3) / 9.0;
+
+		return half * (5.0 * i1 + 8.0 * i2 + 5.0 * i3) / 9.0;
+	}
+
+	/*i, ad and ad2 at every node of a bucket, with ad and ad2 relative to its first node*/
+	void evaluateBucket(const Interp& grid, int bucket, double i0, std::vector<double>& iNodes,
+		std::vector<double>& adNodes, std::vector<double>& ad2Nodes)
+	{
+		const int numNodes = grid.getNumNodes(bucket);
+		iNodes.resize((size_t)numNodes);
+		adNodes.resize((size_t)numNodes);
+		ad2Nodes.resize((size_t)numNodes);
+
+		temp y = newIterate((temp)grid.getNode(bucket, 0));
+		adNodes[0] = ad2Nodes[0] = 0.0;
+		for (int k = 0; k < numNodes; k++)
+		{
+			const double p = grid.getNode(bucket, k);
+			if (k > 0)
+			{
+				const double previous = grid.getNode(bucket, k - 1);
+				double moment;
+				adNodes[(size_t)k] = adNodes[(size_t)k - 1] + integrateCurrent(previous, p, i0, y, &moment);
+				ad2Nodes[(size_t)k] = ad2Nodes[(size_t)k - 1] + (p - previous) * adNodes[(size_t)k - 1] + moment;
+			}
+			iNodes[(size_t)k] = solveCurrent(p, i0, y);
+		}
+	}
+
+	/*
+	Largest interpolation error at the cell midpoints of a slice, as a voltage:
+	K times the error in i, in ad divided by the cell width, or in ad2 divided
+	by the squared cell width, which bound the errors of the first and second
+	order anti-derivative differences. ad2 is skipped if ad2Coeffs is null.
+	*/
+	double measureSliceError(const Interp& grid, const tableTemp* iCoeffs, const tableTemp* adCoeffs, const tableTemp* ad2Coeffs,
+		const std::vector<std::vector<double>>& iNodes, const std::vector<std::vector<double>>& adNodes,
+		const std::vector<std::vector<double>>& ad2Nodes, double i0)
+	{
+		const int g = Interp::numGhostNodes;
+		double worst = 0.0;
+
+		for (int b = 0; b < grid.getNumBuckets(); b++)
+		{
+			const auto& ad = adNodes[(size_t)b];
+			const auto& ad2 = ad2Nodes[(size_t)b];
+			temp y = newIterate((temp)grid.getNode(b, g));
+
+			for (int c = 0; c < grid.getBucketCells(b); c++)
+			{
+				const double left = grid.getNode(b, g + c);
+				const double h = grid.getNode(b, g + c + 1) - left;
+				const double mid = left + 0.5 * h;
+
+				double moment;
+				const double adExact = ad[(size_t)(g + c)] + integrateCurrent(left, mid, i0, y, &moment);
+				const double ad2Exact = ad2[(size_t)(g + c)] + 0.5 * h * ad[(size_t)(g + c)] + moment;
+				const double iExact = solveCurrent(mid, i0, y);
+				const auto pos = grid.locate((tableTemp)mid);
+
+				const double iError = std::abs((double)Interp::evaluate(iCoeffs, pos) - iExact);
+				const double adError = std::abs((double)Interp::evaluate(adCoeffs, pos) - adExact) / h;
+				const double ad2Error = ad2Coeffs != nullptr ? std::abs((double)Interp::evaluate(ad2Coeffs, pos) - ad2Exact) / (h * h) : 0.0;
+				worst = jmax(worst, std::abs((double)ss.K_) * jmax(iError, jmax(adError, ad2Error)));
+			}
+		}
+
+		return worst;
+	}
+
+	/*Solves the non-linearity for y with the selected solver*/
+	forcedinline temp solve(temp p)
+	{
+		switch (solver)
+		{
+		case Solver::dampedNewton:
+			return dampedNewton(newIterate(p), p);
+		case Solver::wrightOmega:
+			return omegaSolve(p);
+		default:
+			return cappedNewton(newIterate(p), p);
+		}
+	}
+
+	/*
+	Explicit solver: the Wright omega estimate is exact for a single diode,
+	and omegaSteps Newton steps correct for the other diode branch. The cost
+	is the same for every sample. The steps are capped like the capped
+	solver's, and if the next step would still be above tol (near p = 0, or
+	at float precision) the capped solver finishes the solve from there.
+	*/
+	forcedinline temp omegaSolve(temp p)
+	{
+		temp y = ClippingType::omegaIterate(p, ss.K_, Is, Vt, Ni);
+		for (int n = 0; n < omegaSteps; n++)
+		{
+			temp step = func(y, p) / dfunc(y);
+			if (fabs(step) > cap)
+			{
+				step = step > 0 ? cap : -cap;
+				solverCounts.capHits++;
+			}
+			y -= step;
+		}
+		solverCounts.iterations += omegaSteps;
+
+		if (!std::isfinite(y) || fabs(func(y, p) / dfunc(y)) > tol)
+			return cappedNewton(std::isfinite(y) ? y : newIterate(p), p);
+
+		solverCounts.solves++;
+		solverCounts.maxIterations = jmax(solverCounts.maxIterations, (uint64)omegaSteps);
+		return y;
 	}
 
-	private:
 	/*Capped Newtons method*/
 	temp cappedNewton(temp y, temp p)
 	{
@@ -249,10 +1237,12 @@ public:
 			if (step > cap)
 			{
 				step = cap;
+				solverCounts.capHits++;
 			}
 			if (step < -1.0f * cap)
 			{
 				step = -1.0f * cap;
+				solverCounts.capHits++;
 			}
 
 			// Newton step
@@ -260,6 +1250,8 @@ public:
 			iter++;
 			cond = fabsf(step);
 		}
+
+		countSolve(iter, cond);
 		return y;
 	}
 
@@ -286,13 +1278,14 @@ public:
 			temp damper = 1.0f;
 			unsigned int subIter = 0;
 
-			while (((fabsf(res) > fabsf(res_old) || isnan(fabsf(res)) || isinf(fabsf(res))) && (subIter < maxSubIter)))
+			while (((fabsf(res) > fabsf(res_old) || std::isnan(fabsf(res)) || std::isinf(fabsf(res))) && (subIter < maxSubIter)))
 			{
 				damper *= 0.5f;
 				y = y_old - damper * step;
 				res = func(y, p);
 				subIter++;
 			}
+			solverCounts.subIterations += subIter;
 
 			J = dfunc(y);
 			step = res / J;
@@ -303,105 +1296,105 @@ public:
 			cond = fabsf(step);
 		}
 
+		countSolve(iter, cond);
 		return y;
 	}
 
-	/*Symmetric clipping function*/
-	temp func(temp y, temp p)
+	/*Adds an iterative solve to the block's counts*/
+	forcedinline void countSolve(unsigned int iter, temp cond)
 	{
-		if (clippingType == ClippingType::symmetric)
-			return p + (2.0 * K_ * Is * sinh(y / (Vt * Ni))) - y;
-		else
-			return p + K_ * Is * (exp(y / (Vt * Ni)) - exp(-y / (2.0 * Vt * Ni))) - y;
+		solverCounts.solves++;
+		solverCounts.iterations += iter;
+		solverCounts.maxIterations = jmax(solverCounts.maxIterations, (uint64)iter);
+		if (cond > tol)
+			solverCounts.nonConverged++;
+	}
+
+	/*Clipping function*/
+	forcedinline temp func(temp y, temp p)
+	{
+		return ClippingType::func(y, p, ss.K_, Is, Vt, Ni);
 	}
 
 	/*Jacobian*/
-	temp dfunc(temp y)
+	forcedinline temp dfunc(temp y)
 	{
-		if (clippingType == ClippingType::symmetric)
-			return (2.0 * K_ * (Is / (Vt * Ni)) * cosh(y / (Vt * Ni))) - 1.0;
-		else
-			return K_ * (Is / (Vt * Ni)) * (exp(y / (Vt * Ni)) + 0.5 * exp(-y / (2.0 * Vt * Ni))) - 1.0;
+		return ClippingType::dfunc(y, ss.K_, Is, Vt, Ni);
 	}
+
 	/*Transitional voltage estimate for capped newtons method*/
 	temp capFunc(temp Q)
 	{
-		if (clippingType == ClippingType::symmetric)
-			return Ni * Vt * acosh(-Ni * Vt / (2.0 * Is * Q));
-		else
-			return fabs(-2.0 * Ni * Vt * log(-2.0 * Ni * Vt / (Q * Is)));
+		return ClippingType::capFunc(Q, Is, Vt, Ni);
+	}
+
+	/*Sets the distortion pot in the continuous time state space model*/
+	void setCircuitDistortion(temp distortion)
+	{
+		potEntry = Circuit::potEntry(distortion);
 	}
 
 	/*New iterate function*/
-	temp newIterate(temp p)
+	forcedinline temp newIterate(temp p)
 	{
-		if (clippingType == ClippingType::symmetric)
-			return Ni * Vt * asinh(p / (2.0 * Is * K_));
-		else
-		{
-			if (p < 0)
-				return -2.0 * Ni * Vt * log(1.0 + p / (K_ * Is));
-			else
-				return Ni * Vt * log(1.0 - p / (K_ * Is));
-		}
+		return ClippingType::newIterate(p, ss.K_, Is, Vt, Ni);
 	}
 
 	// Sample Rate
 	temp fs;
 
-	// state variable
-	temp x[3][1] = { { 0.0 }, { 0.0 }, { 0.0 } };
-	temp xPrev[3][1] = { { 0.0 }, { 0.0 }, { 0.0 } };
-	temp x2Prev[3][1] = { { 0.0 }, { 0.0 }, { 0.0 } };
-
-	// voltage across diodes
-	temp v = 0.0;
-
-	// anti-derivs
-	temp adPrev = 0.0;
-	temp pPrev = 0.0;
-	temp inPrev = 0.0;
-
-	// Circuit parameters
-	temp r1 = 10.0e3;
-	temp r2 = 51.0e3 + 500.0e3;
-	temp r3 = 4.7e3;
-	temp c1 = 1.0e-6;
-	temp c2 = 51e-12;
-	temp c3 = 47e-9;
-	temp Is = 2.52e-9;						
-	temp Vt = 25.85e-3;							
-	temp Ni = 1.752;								
-
-	Matrices<temp> matTool;
-
-	// State space arrays
-	temp A[3][3] = { {-1.0 / (r1 * c1), 0.0, 0.0},
-					{ -1.0 / (r3 * c2), -1.0 / (r2 * c2), -1.0 / (r3 * c2) },
-					{-1.0 / (r3 * c3), 0.0, -1.0 / (r3 * c3)} };
-
-	temp B[3][1] = { {1.0 / (r1 * c1)},{ 1.0 / (r3 * c2)},{ 1.0 / (r3 * c3) } };
-	temp C[3][1] = { {0.0}, {-1.0/c2}, {0.0} };
-	temp D[3] = { -1.0, 1.0, 0.0 };
-	temp E = 1.0;
-	temp G[3] = { 0.0, 1.0, 0.0 };
-
-	temp A_[3][3], B_[3][1], C_[3][1], D_[3], E_, F_, G_[3], H_, I[3][3], K_, Z[3][3];
+	// Per-channel state, one group per SIMD register
+	std::vector<ChannelGroup> groups;
+	std::vector<temp> frameIn, frameOut;
+	int numChans = 0;
+
+	// Diode parameters
+	temp Is = 2.52e-9;
+	temp Vt = 25.85e-3;
+	temp Ni = 1.752;
+
+	// Entry of the continuous time A set by the distortion pot, see Circuit::potEntry
+	temp potEntry = Circuit::potEntry((temp)1.0);
+
+	// Range over fixed resistance of the pot, which spaces the table slices
+	static constexpr double potRatio = Circuit::potRange / Circuit::potFixed;
+
+	// Discretised state space arrays
+	TSStateSpace<temp> ss;
+
+	// Discretised arrays over the distortion range, see buildStateSpaceGrid
+	static constexpr int numStateSpacePoints = 33;
+	static constexpr int numStateSpaceValues = 9 + 4 * 3 + 5;
+	std::vector<temp> stateSpaceGrid;	// numStateSpaceValues per point
+	std::vector<temp> stateSpaceT;		// t at each point
+	temp stateSpaceS = 0.0;
 
 	// Newton raphson parameters
 	temp cap;
-	const temp tol = 1e-7;			   // tolerance
+	const temp tol = sizeof(temp) < sizeof(double) ? (temp)1e-5 : (temp)1e-7;	// tolerance, above the rounding of temp
 	const unsigned int maxIters = 50;  // maximum number of iterations
 	const unsigned int maxSubIter = 5;
-
-	// look-up table
-	temp* pLut;
-	temp* iLut;
-	temp* adLut;
-	size_t N;
-
-	ClippingType clippingType;
-	LagrangeInterp<temp> lagrangeInterp;
+	static constexpr int omegaSteps = 2;	// Newton steps after the Wright omega estimate
+
+	// smallest step in p divided by in the antiAliased2 mode, where cancellation in ad2 matches the fallback error
+	const temp adaa2Threshold = 1.0e-3;
+
+	// error-bounded tables: equal-width p buckets, each with up to maxCellsPerBucket cells
+	static constexpr int numBuckets = 64;
+	static constexpr int maxCellsPerBucket = 1024;
+
+	ProcessMode processMode = ProcessMode::newton;
+	Solver solver = Solver::cappedNewton;
+	TSSolverCounts solverCounts;	// since the start of the current processBlock call
+
+	// distortion x p tables, published by makeLookUpTable or a background build
+	typename Table::Key tableKey;
+	std::shared_ptr<TSTableSlot<const Table>> tableSlot = std::make_shared<TSTableSlot<const Table>>();
+	std::unique_ptr<SharedResourcePointer<TSTableBuildPool>> buildPool;
+	const Table* table = nullptr;	// valid between beginTableAccess and endTableAccess
+	typename Table::SliceWeights sliceWeights;
+	temp distortionValue = 1.0;
+	uint32 distortionVersion = 0;
 };
 
 #endif // !TSClippingStage_h
\ No newline at end of file
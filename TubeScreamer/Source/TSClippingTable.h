@@ -0,0 +1,336 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSClippingTable_h
+#define TSClippingTable_h
+#include "JuceHeader.h"
+#include "PiecewiseLagrangeInterp.h"
+#include <cstring>
+#include <vector>
+
+using namespace juce;
+
+template<class temp, int order = 3>
+
+/*
+Two-dimensional look-up tables of the clipping stage non-linearity.
+
+For numSlices distortion values between 0 and 1, holds the diode current
+i(p), its anti-derivative ad(p) and, for second order anti-aliasing, the
+anti-derivative of that, ad2(p), on a piecewise uniform p grid shared by all
+slices, stored as PiecewiseLagrangeInterp coefficients. Values between
+slices are found with 4-point Lagrange (cubic) interpolation across the
+distortion axis, so the tables stay valid while the Drive knob moves.
+*/
+class TSClippingTable
+{
+public:
+	using Interp = PiecewiseLagrangeInterp<temp, order>;
+
+	/*Which function a table holds*/
+	enum class Kind
+	{
+		current = 0,		// i(p)
+		antiDerivative,		// ad(p)
+		antiDerivative2		// ad2(p), the anti-derivative of ad(p)
+	};
+
+	static constexpr int maxKinds = 3;
+
+	/*Interpolation weights across the distortion axis*/
+	struct SliceWeights
+	{
+		int first = 0;
+		temp w[4] = { 1.0, 0.0, 0.0, 0.0 };
+	};
+
+	/*
+	Everything the table values depend on. All fields are 8 bytes wide so the
+	struct has no padding and can be compared and stored as raw bytes.
+	*/
+	struct Key
+	{
+		int64 clippingType = 0;		// Clipping<temp>::id
+		int64 circuit = 0;			// Circuit::id
+		double potRatio = 0.0;		// Circuit::potRange / Circuit::potFixed, for the slice spacing
+		double sampleRate = 0.0;	// rate the stage is discretised at
+		double pmax = 0.0;			// 0 to derive the range from the circuit
+		int64 numPoints = 0;		// uniform grid size, if maxError is 0
+		double maxError = 0.0;		// target interpolation error in volts, or 0 for a uniform grid
+		int64 numSlices = 0;
+		int64 antiDerivativeOrder = 1;	// 2 to also hold ad2(p)
+		double Is = 0.0;
+		double Vt = 0.0;
+		double Ni = 0.0;
+		int64 interpOrder = order;
+		int64 sampleBytes = sizeof(temp);
+
+		bool operator== (const Key& other) const { return std::memcmp(this, &other, sizeof(Key)) == 0; }
+		bool operator!= (const Key& other) const { return !(*this == other); }
+		bool operator< (const Key& other) const { return std::memcmp(this, &other, sizeof(Key)) < 0; }
+	};
+
+	/*
+	Sets the table dimensions and allocates the coefficients: equal-width
+	buckets over [-range, range], each with its own number of cells.
+	*/
+	void allocate(const Key& keyToUse, temp range, const std::vector<int>& cellsPerBucket)
+	{
+		jassert(keyToUse.numSlices >= 4 && keyToUse.potRatio > 0.0 && !cellsPerBucket.empty());
+		jassert(keyToUse.antiDerivativeOrder >= 1 && 1 + keyToUse.antiDerivativeOrder <= maxKinds);
+
+		setLayout(keyToUse, range, cellsPerBucket);
+		mapped.reset();
+		owned.assign(getNumValues(), 0.0);
+		setData(owned.data());
+		measuredError = 0.0;
+	}
+
+	/*Returns true once the table has been allocated or loaded*/
+	bool isValid() const
+	{
+		return data != nullptr;
+	}
+
+	/*Returns true if the values are read from a memory-mapped file*/
+	bool isMapped() const
+	{
+		return mapped != nullptr;
+	}
+
+	const Key& getKey() const { return key; }
+
+	/*Number of functions held: i, ad and, for antiDerivativeOrder 2, ad2*/
+	int getNumKinds() const
+	{
+		return 1 + (int)key.antiDerivativeOrder;
+	}
+
+	/*Number of coefficients held*/
+	size_t getNumValues() const
+	{
+		return (size_t)getNumKinds() * numSlices * sliceSize;
+	}
+
+	/*Writes the header, bucket layout and coefficients in the cache file format*/
+	bool writeTo(OutputStream& out) const
+	{
+		jassert(isValid());
+		FileHeader header;
+		header.key = key;
+		header.numValues = (int64)getNumValues();
+		header.numBuckets = (int64)grid.getNumBuckets();
+		header.range = (double)pmax;
+		header.measuredError = measuredError;
+
+		std::vector<int32> layout(getLayoutBytes(grid.getNumBuckets()) / sizeof(int32), 0);
+		for (int b = 0; b < grid.getNumBuckets(); b++)
+			layout[(size_t)b] = grid.getBucketCells(b);
+
+		return out.write(&header, sizeof(FileHeader))
+			&& out.write(layout.data(), layout.size() * sizeof(int32))
+			&& out.write(data, getNumValues() * sizeof(temp));
+	}
+
+	/*
+	Memory-maps a table written by writeTo, if its header matches the expected key.
+	The pages are shared read-only with every other process mapping the same file.
+	*/
+	bool mapFrom(const File& file, const Key& expectedKey)
+	{
+		auto mapping = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+
+		if (mapping->getData() == nullptr || mapping->getSize() < sizeof(FileHeader))
+			return false;
+
+		FileHeader expected, found;
+		std::memcpy(&found, mapping->getData(), sizeof(FileHeader));
+
+		// The layout and range are results of the build, so take them from the file
+		expected.key = expectedKey;
+		expected.numBuckets = found.numBuckets;
+		expected.range = found.range;
+		expected.measuredError = found.measuredError;
+
+		const size_t layoutBytes = getLayoutBytes((int)found.numBuckets);
+		if (found.numBuckets < 1 || found.numBuckets > maxBuckets
+			|| mapping->getSize() < sizeof(FileHeader) + layoutBytes)
+			return false;
+
+		const char* bytes = static_cast<const char*>(mapping->getData());
+		std::vector<int> cellsPerBucket((size_t)found.numBuckets);
+		for (size_t b = 0; b < cellsPerBucket.size(); b++)
+		{
+			int32 cells;
+			std::memcpy(&cells, bytes + sizeof(FileHeader) + b * sizeof(int32), sizeof(int32));
+			if (cells < 1)
+				return false;
+			cellsPerBucket[b] = cells;
+		}
+
+		setLayout(expectedKey, (temp)found.range, cellsPerBucket);
+		expected.numValues = (int64)getNumValues();
+
+		if (std::memcmp(&expected, &found, sizeof(FileHeader)) != 0
+			|| mapping->getSize() != sizeof(FileHeader) + layoutBytes + getNumValues() * sizeof(temp))
+		{
+			data = nullptr;
+			return false;
+		}
+
+		owned.clear();
+		owned.shrink_to_fit();
+		mapped = std::move(mapping);
+		measuredError = found.measuredError;
+		setData(reinterpret_cast<const temp*>(static_cast<const char*>(mapped->getData()) + sizeof(FileHeader) + layoutBytes));
+		return true;
+	}
+
+	size_t getNumSlices() const { return numSlices; }
+	temp getPMax() const { return pmax; }
+	const Interp& getGrid() const { return grid; }
+
+	/*Largest interpolation error found when the table was built, in volts*/
+	double getMeasuredError() const { return measuredError; }
+	void setMeasuredError(double error) { measuredError = error; }
+
+	/*Distortion value of a slice*/
+	temp getSliceDistortion(size_t slice) const
+	{
+		return getSliceDistortion(slice, numSlices, key.potRatio);
+	}
+
+	static temp getSliceDistortion(size_t slice, size_t numSlices, double potRatio)
+	{
+		return axisToDistortion((temp)slice / (temp)(numSlices - 1), potRatio);
+	}
+
+	/*Coefficients of one function at one slice, for filling an allocated table*/
+	temp* getCoefficients(Kind kind, size_t slice)
+	{
+		jassert(!isMapped() && (int)kind < getNumKinds());
+		return owned.data() + ((size_t)kind * numSlices + slice) * sliceSize;
+	}
+
+	const temp* getCoefficients(Kind kind, size_t slice) const
+	{
+		return data + ((size_t)kind * numSlices + slice) * sliceSize;
+	}
+
+	/*Weights of the four slices nearest to a distortion value*/
+	SliceWeights getSliceWeights(temp distortion) const
+	{
+		return getSliceWeights(distortion, numSlices, key.potRatio);
+	}
+
+	/*Weights of the four slices nearest to a distortion value, for a table of numSlices slices*/
+	static SliceWeights getSliceWeights(temp distortion, size_t numSlices, double potRatio)
+	{
+		SliceWeights sw;
+		const temp u = distortionToAxis(jlimit((temp)0.0, (temp)1.0, distortion), potRatio) * (temp)(numSlices - 1);
+		sw.first = jlimit(0, (int)numSlices - 4, (int)std::floor(u) - 1);
+
+		const temp t = u - (temp)sw.first;
+		for (int i = 0; i < 4; i++)
+		{
+			temp w = 1.0;
+			for (int j = 0; j < 4; j++)
+				if (j != i)
+					w *= (t - (temp)j) / (temp)(i - j);
+			sw.w[i] = w;
+		}
+		return sw;
+	}
+
+	/*Looks up one function at p, interpolating across the distortion axis*/
+	inline temp lookUp(Kind kind, const SliceWeights& sw, temp p) const
+	{
+		const auto pos = grid.locate(p);
+		const temp* c = getCoefficients(kind, (size_t)sw.first);
+
+		return sw.w[0] * Interp::evaluate(c, pos)
+			+ sw.w[1] * Interp::evaluate(c + sliceSize, pos)
+			+ sw.w[2] * Interp::evaluate(c + 2 * sliceSize, pos)
+			+ sw.w[3] * Interp::evaluate(c + 3 * sliceSize, pos);
+	}
+
+private:
+	/*
+	Slices are evenly spaced in log(r), where r = potFixed + distortion *
+	potRange is the circuit's distortion resistor and potRatio = potRange /
+	potFixed, since the non-linearity changes fastest at low distortion.
+	*/
+	static temp distortionToAxis(temp distortion, double potRatio)
+	{
+		return std::log(1.0 + distortion * potRatio) / std::log(1.0 + potRatio);
+	}
+
+	static temp axisToDistortion(temp axis, double potRatio)
+	{
+		return (std::exp(axis * std::log(1.0 + potRatio)) - 1.0) / potRatio;
+	}
+
+	// Bump whenever the table generation or layout changes, to invalidate cached files
+	static constexpr int64 formatVersion = 5;
+
+	/*
+	Cache file header, padded so the coefficients that follow stay aligned.
+	It is followed by the cells of each bucket as int32, padded to 64 bytes,
+	and then the coefficients.
+	*/
+	struct FileHeader
+	{
+		char magic[8] = { 'T', 'S', 'C', 'L', 'I', 'P', 'L', 'T' };
+		int64 version = formatVersion;
+		int64 numValues = 0;
+		Key key;
+		int64 numBuckets = 0;
+		double range = 0.0;
+		double measuredError = 0.0;
+		char reserved[32] = {};
+	};
+
+	static_assert(sizeof(Key) == 14 * sizeof(int64), "Key must not contain padding");
+	static_assert(sizeof(FileHeader) == 192, "FileHeader must not contain padding");
+
+	static constexpr int64 maxBuckets = 1 << 16;
+
+	static size_t getLayoutBytes(int numBuckets)
+	{
+		return (((size_t)numBuckets * sizeof(int32) + 63) / 64) * 64;
+	}
+
+	void setLayout(const Key& keyToUse, temp range, const std::vector<int>& cellsPerBucket)
+	{
+		key = keyToUse;
+		numSlices = (size_t)key.numSlices;
+		pmax = range;
+		grid.setLayout(-pmax, pmax, cellsPerBucket);
+		sliceSize = grid.getNumCoefficients();
+	}
+
+	void setData(const temp* values)
+	{
+		data = values;
+		grid.setCoefficients(data);
+	}
+
+	Key key;
+	size_t numSlices = 0;		// distortion values
+	size_t sliceSize = 0;		// coefficients per slice
+	temp pmax = 0.0;			// p range of the grid
+	double measuredError = 0.0;
+
+	// coefficients, either owned or memory-mapped
+	std::vector<temp> owned;
+	std::unique_ptr<MemoryMappedFile> mapped;
+	const temp* data = nullptr;
+	Interp grid;
+};
+
+#endif // !TSClippingTable_h
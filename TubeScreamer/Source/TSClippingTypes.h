@@ -0,0 +1,111 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSClippingTypes_h
+#define TSClippingTypes_h
+#include "WrightOmega.h"
+#include <cmath>
+
+/*
+Diode clipping policies for TSClippingStage.
+
+Each policy describes the diode current i(y) through the feedback diodes and
+supplies the functions the stage needs to solve p + K i(y) - y = 0:
+func		- residual of the implicit equation
+dfunc		- derivative of the residual with respect to y
+capFunc		- transitional voltage used to cap Newton steps
+newIterate	- initial estimate of y for the Newton solver
+omegaIterate	- explicit estimate of y from the Wright omega function, treating
+			  the conducting diode(s) as a single exponential
+
+To add a topology, write a new policy with the same static functions and
+instantiate TSClippingStage with it.
+*/
+
+template<class temp>
+
+/*
+Symmetric clipping: two identical diodes in anti-parallel
+*/
+struct SymmetricClipping
+{
+	static constexpr int id = 0;
+
+	static temp func(temp y, temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		return p + (2.0 * K * Is * sinh(y / (Vt * Ni))) - y;
+	}
+
+	static temp dfunc(temp y, temp K, temp Is, temp Vt, temp Ni)
+	{
+		return (2.0 * K * (Is / (Vt * Ni)) * cosh(y / (Vt * Ni))) - 1.0;
+	}
+
+	static temp capFunc(temp Q, temp Is, temp Vt, temp Ni)
+	{
+		return Ni * Vt * acosh(-Ni * Vt / (2.0 * Is * Q));
+	}
+
+	static temp newIterate(temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		return Ni * Vt * asinh(p / (2.0 * Is * K));
+	}
+
+	static temp omegaIterate(temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		// y = |p| + K Is (e^(y/a) - 1), odd in p
+		const temp a = Ni * Vt;
+		const temp q = fabs(p) - K * Is;
+		const temp y = q - a * WrightOmega<temp>::omega4(log(-K * Is / a) + q / a);
+		return p < 0 ? -y : y;
+	}
+};
+
+template<class temp>
+
+/*
+Asymmetric clipping: one diode in one direction, two in series in the other
+*/
+struct AsymmetricClipping
+{
+	static constexpr int id = 1;
+
+	static temp func(temp y, temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		return p + K * Is * (exp(y / (Vt * Ni)) - exp(-y / (2.0 * Vt * Ni))) - y;
+	}
+
+	static temp dfunc(temp y, temp K, temp Is, temp Vt, temp Ni)
+	{
+		return K * (Is / (Vt * Ni)) * (exp(y / (Vt * Ni)) + 0.5 * exp(-y / (2.0 * Vt * Ni))) - 1.0;
+	}
+
+	static temp capFunc(temp Q, temp Is, temp Vt, temp Ni)
+	{
+		return fabs(-2.0 * Ni * Vt * log(-2.0 * Ni * Vt / (Q * Is)));
+	}
+
+	static temp newIterate(temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		if (p < 0)
+			return -2.0 * Ni * Vt * log(1.0 + p / (K * Is));
+		else
+			return Ni * Vt * log(1.0 - p / (K * Is));
+	}
+
+	static temp omegaIterate(temp p, temp K, temp Is, temp Vt, temp Ni)
+	{
+		// y = |p| + K Is (e^(y/a) - 1), with the two series diodes conducting for p < 0
+		const temp a = p < 0 ? 2.0 * Ni * Vt : Ni * Vt;
+		const temp q = fabs(p) - K * Is;
+		const temp y = q - a * WrightOmega<temp>::omega4(log(-K * Is / a) + q / a);
+		return p < 0 ? -y : y;
+	}
+};
+
+#endif // !TSClippingTypes_h
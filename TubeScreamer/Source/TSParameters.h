@@ -0,0 +1,164 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSParameters_h
+#define TSParameters_h
+#include "JuceHeader.h"
+#include <atomic>
+
+using namespace juce;
+
+/*
+The plugin parameters as the audio thread sees them for one block.
+
+Each raw parameter value is loaded once at the start of the block, so every
+stage works from the same values however the host or editor writes them
+meanwhile, and nothing in the block dereferences the parameter atomics again.
+*/
+struct TSParameterSnapshot
+{
+	float distortion = 0.0f;
+	float tone = 0.0f;
+	float level = 0.0f;
+	bool aa = true;
+	bool symm = false;
+	int osFactorLog2 = 1;
+	int osFilter = 0;
+
+	/*Groups of fields that share the DSP state they feed*/
+	enum Field
+	{
+		distortionField = 1,
+		toneField = 2,
+		levelField = 4,
+		modeField = 8,				// aa and clip type
+		oversamplingField = 16
+	};
+
+	/*Reads the raw parameter values*/
+	static TSParameterSnapshot read(const std::atomic<float>& distortion, const std::atomic<float>& tone, const std::atomic<float>& level,
+		const std::atomic<float>& aa, const std::atomic<float>& clipType, const std::atomic<float>& osFactor, const std::atomic<float>& osFilter) noexcept
+	{
+		TSParameterSnapshot snapshot;
+		snapshot.distortion = distortion.load(std::memory_order_relaxed);
+		snapshot.tone = tone.load(std::memory_order_relaxed);
+		snapshot.level = level.load(std::memory_order_relaxed);
+		snapshot.aa = (int)aa.load(std::memory_order_relaxed) != 0;
+		snapshot.symm = (int)clipType.load(std::memory_order_relaxed) < 1;
+		snapshot.osFactorLog2 = (int)osFactor.load(std::memory_order_relaxed);
+		snapshot.osFilter = (int)osFilter.load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+	/*Fields that differ from another snapshot, as a mask of Field values*/
+	int changedFields(const TSParameterSnapshot& other) const noexcept
+	{
+		int changed = 0;
+		if (distortion != other.distortion)
+			changed |= distortionField;
+		if (tone != other.tone)
+			changed |= toneField;
+		if (level != other.level)
+			changed |= levelField;
+		if (aa != other.aa || symm != other.symm)
+			changed |= modeField;
+		if (osFactorLog2 != other.osFactorLog2 || osFilter != other.osFilter)
+			changed |= oversamplingField;
+		return changed;
+	}
+};
+
+/*How often the processor has recomputed each piece of parameter dependent state*/
+struct TSParameterCounts
+{
+	uint64 blocks = 0;
+	uint64 changedBlocks = 0;		// blocks whose snapshot differed from the last
+	uint64 distortionTargets = 0;	// Drive smoother retargeted
+	uint64 toneTargets = 0;			// Tone smoother retargeted
+	uint64 levelTargets = 0;		// Level smoother retargeted
+	uint64 modeChanges = 0;			// clipping stage selection changed
+	uint64 distortionUpdates = 0;	// state space arrays recomputed by the clipping engine
+	uint64 toneUpdates = 0;			// tone coefficients recomputed by the output stage
+	uint64 engineRequests = 0;		// clipping engines built for new oversampling settings
+};
+
+/*
+Parameter update counts handed from the processor to any reader.
+
+Each counter is its own relaxed atomic with a single writer, so neither side
+waits; a reader may see one counter a block ahead of another.
+*/
+class TSParameterStats
+{
+public:
+	/*Audio thread: counts one block and the recomputations it made*/
+	void addBlock(int changedFields, int numDistortionUpdates, int numToneUpdates) noexcept
+	{
+		if (resetRequested.exchange(false))
+			for (auto& counter : counters)
+				counter.store(0, std::memory_order_relaxed);
+
+		increment(blocks);
+		if (changedFields != 0)
+			increment(changedBlocks);
+		if ((changedFields & TSParameterSnapshot::distortionField) != 0)
+			increment(distortionTargets);
+		if ((changedFields & TSParameterSnapshot::toneField) != 0)
+			increment(toneTargets);
+		if ((changedFields & TSParameterSnapshot::levelField) != 0)
+			increment(levelTargets);
+		if ((changedFields & TSParameterSnapshot::modeField) != 0)
+			increment(modeChanges);
+
+		increment(distortionUpdates, (uint64)numDistortionUpdates);
+		increment(toneUpdates, (uint64)numToneUpdates);
+	}
+
+	/*Message thread: counts an engine build for new oversampling settings*/
+	void addEngineRequest() noexcept
+	{
+		counters[engineRequests].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/*Any thread: the counts so far*/
+	TSParameterCounts get() const noexcept
+	{
+		TSParameterCounts counts;
+		uint64* values[numCounters] = { &counts.blocks, &counts.changedBlocks, &counts.distortionTargets, &counts.toneTargets,
+			&counts.levelTargets, &counts.modeChanges, &counts.distortionUpdates, &counts.toneUpdates, &counts.engineRequests };
+
+		for (int i = 0; i < numCounters; i++)
+			*values[i] = counters[i].load(std::memory_order_relaxed);
+
+		return counts;
+	}
+
+	/*Any thread: clears the counts when the next block is added*/
+	void reset() noexcept
+	{
+		resetRequested.store(true);
+	}
+
+private:
+	enum Counter
+	{
+		blocks, changedBlocks, distortionTargets, toneTargets, levelTargets,
+		modeChanges, distortionUpdates, toneUpdates, engineRequests, numCounters
+	};
+
+	// audio thread counters have a single writer, so no read-modify-write is needed
+	void increment(Counter counter, uint64 amount = 1) noexcept
+	{
+		counters[counter].store(counters[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64> counters[numCounters] = {};
+	std::atomic<bool> resetRequested{ false };
+};
+
+#endif // !TSParameters_h
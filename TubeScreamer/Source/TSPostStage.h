@@ -0,0 +1,168 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSPostStage_h
+#define TSPostStage_h
+#include "JuceHeader.h"
+#include "TSTone.h"
+
+using namespace juce;
+
+template<class temp>
+
+/*
+Base rate output stage: output level, tone filter and the 3 Hz DC-blocking
+high pass in a single pass over each channel.
+
+The tone and high pass biquads run as one cascade in transposed direct form
+II with both states in registers, so every sample is loaded and stored once
+instead of once per filter. Coefficients are the same as TSTone's and
+IIRCoefficients::makeHighPass, and are only touched on the audio thread, so
+no lock is taken.
+
+While the tone is smoothing, its coefficients are looked up in a
+TSToneTable every toneSubBlock samples, so sweeps are free of zipper noise
+without running the bilinear transform per update.
+*/
+class TSPostStage
+{
+public:
+	/*Sets the rate and sizes the per-block gain ramp. Clears the filter states*/
+	void prepare(temp sampleRate, int maxBlockSize, int numChannels)
+	{
+		toneTable.build(sampleRate);
+		toneTable.getCoefficients(toneValue, toneCoefficients);
+
+		const auto highPass = IIRCoefficients::makeHighPass(sampleRate, 3.0);
+		for (int i = 0; i < 5; i++)
+			highPassCoefficients[i] = (temp)highPass.coefficients[i];
+
+		gains.resize((size_t)jmax(1, maxBlockSize));
+		states.assign((size_t)numChannels, State());
+	}
+
+	/*Jumps to a tone knob position 0 <= tone <= 1*/
+	void setTone(temp newTone)
+	{
+		toneValue = newTone;
+		if (!toneTable.isEmpty())
+			toneTable.getCoefficients(toneValue, toneCoefficients);
+	}
+
+	void reset()
+	{
+		std::fill(states.begin(), states.end(), State());
+	}
+
+	/*
+	Applies the level, tone and high pass to the first numChannels channels in
+	place. The level ramp is shared by every channel, as applyGain would; the
+	tone follows its smoothed value one sub-block at a time. Returns the
+	number of tone coefficient updates made.
+	*/
+	int process(temp* const* channels, int numChannels, int numSamples, SmoothedValue<temp>& level, SmoothedValue<temp>& tone)
+	{
+		numChannels = jmin(numChannels, (int)states.size());
+		int numUpdates = 0;
+
+		for (int pos = 0; pos < numSamples; pos += (int)gains.size())
+		{
+			const int n = jmin((int)gains.size(), numSamples - pos);
+			const bool ramp = level.isSmoothing();
+
+			if (ramp)
+				for (int i = 0; i < n; i++)
+					gains[(size_t)i] = level.getNextValue();
+
+			for (int sub = 0; sub < n;)
+			{
+				int m = n - sub;
+				if (tone.isSmoothing())
+				{
+					m = jmin(m, toneSubBlock);
+					setTone(tone.skip(m));
+					numUpdates++;
+				}
+				else if (tone.getTargetValue() != toneValue)
+				{
+					setTone(tone.getTargetValue());
+					numUpdates++;
+				}
+
+				for (int channel = 0; channel < numChannels; channel++)
+				{
+					temp* samples = channels[channel] + pos + sub;
+					if (ramp)
+						processChannel<true>(samples, m, states[(size_t)channel], gains.data() + sub, 0.0);
+					else
+						processChannel<false>(samples, m, states[(size_t)channel], nullptr, level.getTargetValue());
+				}
+
+				sub += m;
+			}
+		}
+
+		return numUpdates;
+	}
+
+	// Samples between tone coefficient updates while the tone is smoothing
+	static constexpr int toneSubBlock = 32;
+
+private:
+	/*Transposed direct form II states of the two biquads*/
+	struct State
+	{
+		temp tone1 = 0.0, tone2 = 0.0;
+		temp highPass1 = 0.0, highPass2 = 0.0;
+	};
+
+	template <bool ramp>
+	void processChannel(temp* samples, int numSamples, State& state, const temp* gain, temp constantGain)
+	{
+		const temp tb0 = toneCoefficients[0], tb1 = toneCoefficients[1], tb2 = toneCoefficients[2];
+		const temp ta1 = toneCoefficients[3], ta2 = toneCoefficients[4];
+		const temp hb0 = highPassCoefficients[0], hb1 = highPassCoefficients[1], hb2 = highPassCoefficients[2];
+		const temp ha1 = highPassCoefficients[3], ha2 = highPassCoefficients[4];
+
+		temp t1 = state.tone1, t2 = state.tone2;
+		temp h1 = state.highPass1, h2 = state.highPass2;
+
+		for (int i = 0; i < numSamples; i++)
+		{
+			const temp in = samples[i] * (ramp ? gain[i] : constantGain);
+
+			const temp toned = tb0 * in + t1;
+			t1 = tb1 * in - ta1 * toned + t2;
+			t2 = tb2 * in - ta2 * toned;
+
+			const temp out = hb0 * toned + h1;
+			h1 = hb1 * toned - ha1 * out + h2;
+			h2 = hb2 * toned - ha2 * out;
+
+			samples[i] = out;
+		}
+
+		JUCE_SNAP_TO_ZERO(t1);
+		JUCE_SNAP_TO_ZERO(t2);
+		JUCE_SNAP_TO_ZERO(h1);
+		JUCE_SNAP_TO_ZERO(h2);
+		state = { t1, t2, h1, h2 };
+	}
+
+	// Coefficients: b0, b1, b2, a1, a2
+	temp toneCoefficients[5] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+	temp highPassCoefficients[5] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+
+	TSToneTable<temp> toneTable;
+	temp toneValue = 1.0;		// tone of the current coefficients
+
+	std::vector<temp> gains;	// level ramp of the current chunk
+	std::vector<State> states;	// one per channel
+};
+
+#endif // !TSPostStage_h
@@ -0,0 +1,135 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSSolverStats_h
+#define TSSolverStats_h
+#include "JuceHeader.h"
+#include <atomic>
+
+using namespace juce;
+
+/*Work done by the clipping stage solvers, counted over one or more blocks*/
+struct TSSolverCounts
+{
+	uint64 solves = 0;
+	uint64 iterations = 0;			// Newton steps over every solve
+	uint64 subIterations = 0;		// step halvings of the damped solver
+	uint64 capHits = 0;				// steps limited by the capped solver
+	uint64 nonConverged = 0;		// solves that stopped at the iteration limit
+	uint64 maxIterations = 0;		// most steps taken by any one solve
+
+	void add(const TSSolverCounts& other)
+	{
+		solves += other.solves;
+		iterations += other.iterations;
+		subIterations += other.subIterations;
+		capHits += other.capHits;
+		nonConverged += other.nonConverged;
+		maxIterations = jmax(maxIterations, other.maxIterations);
+	}
+};
+
+/*
+Per-block solver counts handed from the audio thread to any reader.
+
+The audio thread calls addBlock() once per block; it only does relaxed
+atomic stores and never waits. Readers take a consistent snapshot with
+get(), retrying if a block was added while they were copying (a seqlock).
+*/
+class TSSolverStats
+{
+public:
+	/*Counts seen by a reader*/
+	struct Snapshot
+	{
+		uint64 numBlocks = 0;
+		TSSolverCounts total;
+		TSSolverCounts lastBlock;
+		TSSolverCounts worstBlock;		// block with the most iterations
+	};
+
+	/*Audio thread: adds the counts of a finished block*/
+	void addBlock(const TSSolverCounts& block) noexcept
+	{
+		if (resetRequested.exchange(false))
+			owned = Snapshot();
+
+		owned.numBlocks++;
+		owned.total.add(block);
+		owned.lastBlock = block;
+		if (block.iterations >= owned.worstBlock.iterations)
+			owned.worstBlock = block;
+
+		const uint64 s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		published[0].store(owned.numBlocks, std::memory_order_relaxed);
+		store(1, owned.total);
+		store(1 + numFields, owned.lastBlock);
+		store(1 + 2 * numFields, owned.worstBlock);
+
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	/*Any thread: the counts so far*/
+	Snapshot get() const noexcept
+	{
+		Snapshot snapshot;
+		uint64 before, after;
+
+		do
+		{
+			before = sequence.load(std::memory_order_acquire);
+			snapshot.numBlocks = published[0].load(std::memory_order_relaxed);
+			load(1, snapshot.total);
+			load(1 + numFields, snapshot.lastBlock);
+			load(1 + 2 * numFields, snapshot.worstBlock);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence.load(std::memory_order_relaxed);
+		} while (before != after || (before & 1) != 0);
+
+		return snapshot;
+	}
+
+	/*Any thread: clears the counts when the next block is added*/
+	void reset() noexcept
+	{
+		resetRequested.store(true);
+	}
+
+private:
+	static constexpr int numFields = 6;
+
+	void store(int first, const TSSolverCounts& counts) noexcept
+	{
+		const uint64 values[numFields] = { counts.solves, counts.iterations, counts.subIterations,
+			counts.capHits, counts.nonConverged, counts.maxIterations };
+
+		for (int i = 0; i < numFields; i++)
+			published[first + i].store(values[i], std::memory_order_relaxed);
+	}
+
+	void load(int first, TSSolverCounts& counts) const noexcept
+	{
+		uint64* values[numFields] = { &counts.solves, &counts.iterations, &counts.subIterations,
+			&counts.capHits, &counts.nonConverged, &counts.maxIterations };
+
+		for (int i = 0; i < numFields; i++)
+			*values[i] = published[first + i].load(std::memory_order_relaxed);
+	}
+
+	// audio thread only
+	Snapshot owned;
+
+	std::atomic<uint64> sequence{ 0 };	// odd while a block is being published
+	std::atomic<uint64> published[1 + 3 * numFields] = {};
+	std::atomic<bool> resetRequested{ false };
+};
+
+#endif // !TSSolverStats_h
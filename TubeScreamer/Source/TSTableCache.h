@@ -0,0 +1,91 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSTableCache_h
+#define TSTableCache_h
+#include "JuceHeader.h"
+
+using namespace juce;
+
+/*
+On-disk cache of clipping stage look-up tables.
+
+Tables are written once, named after a hash of their key, and memory-mapped
+read-only on later loads so that every plugin instance and process shares
+the same physical pages. A file whose header does not match the expected
+key exactly is ignored and rebuilt.
+*/
+namespace TSTableCache
+{
+	/*Folder the tables are kept in, shared by all processes of the user*/
+	inline File& getDirectory()
+	{
+		static File directory = File::getSpecialLocation(File::userApplicationDataDirectory)
+			.getChildFile("TubeScreamer").getChildFile("TableCache");
+		return directory;
+	}
+
+	/*Overrides the cache folder, e.g. for a headless render*/
+	inline void setDirectory(const File& newDirectory)
+	{
+		getDirectory() = newDirectory;
+	}
+
+	/*64-bit FNV-1a hash of a key's bytes*/
+	template <class Key>
+	uint64 hashKey(const Key& key)
+	{
+		uint64 hash = 14695981039346656037ull;
+		auto bytes = reinterpret_cast<const uint8*>(&key);
+		for (size_t i = 0; i < sizeof(Key); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	/*Cache file of a table, with the readable parts of the key in the name*/
+	template <class Key>
+	File getFile(const Key& key)
+	{
+		const String name = "clip" + String(key.clippingType)
+			+ "_" + String(roundToInt(key.sampleRate)) + "Hz"
+			+ "_" + String(key.numSlices) + "x" + String(key.numPoints)
+			+ "_" + String::toHexString((int64)hashKey(key)) + ".tslut";
+		return getDirectory().getChildFile(name);
+	}
+
+	/*Maps the cached table for a key, returning false if there is none*/
+	template <class Table>
+	bool load(Table& table, const typename Table::Key& key)
+	{
+		const File file = getFile(key);
+		return file.existsAsFile() && table.mapFrom(file, key);
+	}
+
+	/*
+	Writes a table to the cache. The file is written next to its final name
+	and moved into place, so other processes never map a partial table.
+	*/
+	template <class Table>
+	bool save(const Table& table)
+	{
+		const File file = getFile(table.getKey());
+		if (!file.getParentDirectory().createDirectory())
+			return false;
+
+		TemporaryFile temp(file);
+		{
+			FileOutputStream out(temp.getFile());
+			if (!out.openedOk() || !table.writeTo(out))
+				return false;
+			out.flush();
+		}
+		return temp.overwriteTargetFileWithTemporary();
+	}
+}
+
+#endif // !TSTableCache_h
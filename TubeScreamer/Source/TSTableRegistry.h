@@ -0,0 +1,96 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSTableRegistry_h
+#define TSTableRegistry_h
+#include "JuceHeader.h"
+#include <map>
+#include <memory>
+#include <mutex>
+
+template<class Table>
+
+/*
+Process-wide registry of immutable look-up tables.
+
+Every stage asking for a table with the same key gets the same instance.
+The registry itself only holds weak references, so a table is freed when
+the last stage using it is destroyed or moves on to another key.
+*/
+class TSTableRegistry
+{
+public:
+	using Key = typename Table::Key;
+	using TablePtr = std::shared_ptr<const Table>;
+
+	/*
+	Returns the shared table for a key, calling build(Table&) to fill it in
+	if no stage currently holds one. build runs without the registry locked,
+	so other keys can be acquired meanwhile; if two threads build the same
+	key at once, the first one to finish wins and the other copy is dropped.
+	*/
+	template <class BuildFunction>
+	static TablePtr acquire(const Key& key, BuildFunction&& build)
+	{
+		if (auto existing = find(key))
+			return existing;
+
+		auto fresh = std::make_shared<Table>();
+		build(*fresh);
+
+		std::lock_guard<std::mutex> lock(getMutex());
+		auto& slot = getMap()[key];
+		if (auto existing = slot.lock())
+			return existing;
+
+		TablePtr shared = std::move(fresh);
+		slot = shared;
+		return shared;
+	}
+
+	/*Number of tables currently alive in the process*/
+	static size_t getNumTables()
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		purge();
+		return getMap().size();
+	}
+
+private:
+	using Map = std::map<Key, std::weak_ptr<const Table>>;
+
+	static TablePtr find(const Key& key)
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		purge();
+		auto it = getMap().find(key);
+		return it != getMap().end() ? it->second.lock() : nullptr;
+	}
+
+	/*Drops entries whose table has been released*/
+	static void purge()
+	{
+		auto& map = getMap();
+		for (auto it = map.begin(); it != map.end();)
+			it = it->second.expired() ? map.erase(it) : std::next(it);
+	}
+
+	static Map& getMap()
+	{
+		static Map map;
+		return map;
+	}
+
+	static std::mutex& getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+};
+
+#endif // !TSTableRegistry_h
@@ -0,0 +1,133 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSTableSlot_h
+#define TSTableSlot_h
+#include "JuceHeader.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace juce;
+
+template<class Table>
+
+/*
+Hands look-up tables from a builder thread to the audio thread. Table is
+const-qualified for shared read-only tables; a non-const Table may be
+mutated by the audio thread between enter() and exit(), as long as no
+other thread touches it after publish().
+
+The audio thread brackets each block with enter() and exit(), which only
+touch two atomics. Other threads publish() new tables with an atomic pointer
+swap. A replaced table is kept alive until the audio thread is seen outside
+a block, or in a later block than the one running at the swap, so it is
+never freed under the reader and never freed on the audio thread. The audio
+thread can hold() up to two tables it still needs across blocks, such as
+one it is fading out, and they are kept until it stops holding them.
+*/
+class TSTableSlot
+{
+public:
+	using TablePtr = std::shared_ptr<Table>;
+
+	/*Audio thread: pins the current table (or nullptr) until exit()*/
+	Table* enter() noexcept
+	{
+		readerEpoch.fetch_add(1);		// odd while inside a block
+		return current.load();
+	}
+
+	/*Audio thread: releases the table returned by enter()*/
+	void exit() noexcept
+	{
+		readerEpoch.fetch_add(1);
+	}
+
+	/*
+	Audio thread: keeps tables returned by enter() alive after they are
+	replaced, until hold() is called again without them. Released tables are
+	freed by the next publish() or collectGarbage().
+	*/
+	void hold(Table* first, Table* second = nullptr) noexcept
+	{
+		held[0].store(first);
+		held[1].store(second);
+	}
+
+	/*Starts a new request; publish() drops results of requests made before it*/
+	uint64 newRequest()
+	{
+		return ++latestRequest;
+	}
+
+	/*Publishes the result of a request, if no later request has been made since*/
+	bool publish(TablePtr newTable, uint64 request)
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		if (request != latestRequest.load())
+			return false;
+
+		current.store(newTable.get());
+		retired.push_back({ std::move(owner), readerEpoch.load() });
+		owner = std::move(newTable);
+		collect();
+		return true;
+	}
+
+	/*Frees replaced tables the audio thread can no longer be reading*/
+	void collectGarbage()
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		collect();
+	}
+
+	/*The most recently published table, for use off the audio thread*/
+	TablePtr get() const
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		return owner;
+	}
+
+private:
+	struct Retired
+	{
+		TablePtr table;
+		uint64 epoch;	// reader epoch seen when the table was replaced
+	};
+
+	void collect()
+	{
+		const uint64 epoch = readerEpoch.load();
+		retired.erase(std::remove_if(retired.begin(), retired.end(), [this, epoch](const Retired& r)
+		{
+			if (r.table.get() == held[0].load() || r.table.get() == held[1].load())
+				return false;
+			return (r.epoch & 1) == 0 || r.epoch != epoch;
+		}), retired.end());
+	}
+
+	std::atomic<Table*> current{ nullptr };
+	std::atomic<uint64> readerEpoch{ 0 };
+	std::atomic<uint64> latestRequest{ 0 };
+	std::atomic<Table*> held[2] = { { nullptr }, { nullptr } };
+
+	// only touched by non-audio threads
+	mutable std::mutex writerMutex;
+	TablePtr owner;
+	std::vector<Retired> retired;
+};
+
+/*Single background thread shared by every stage for building tables*/
+struct TSTableBuildPool : public ThreadPool
+{
+	TSTableBuildPool() : ThreadPool(1) {}
+};
+
+#endif // !TSTableSlot_h
@@ -38,6 +38,15 @@ public:
 
 	/*Set tone knob position 0 <= tone <= 1*/
 	void setTone(temp tone)
+	{
+		calculateCoefficients(tone);
+
+		// Set filter coefficients
+		filter.setCoefficients(IIRCoefficients(b[0], b[1], b[2], a[0], a[1], a[2]));
+	}
+
+	/*Calculates the coefficients for a tone knob position without touching the filter*/
+	void calculateCoefficients(temp tone)
 	{
 		if (tone > 1.0)
 			tone = 1.0;
@@ -67,9 +76,9 @@ public:
 		b[0] = b0 + b1 * c;
 		b[1] = 2.0 * b0;
 		b[2] = b0 - b1 * c;
-		a[0] = a0 + a1 * c + pow(c, 2);
-		a[1] = 2.0 * a0 - 2.0 * pow(c, 2);
-		a[2] = a0 - a1 * c + pow(c, 2);
+		a[0] = a0 + a1 * c + c * c;
+		a[1] = 2.0 * a0 - 2.0 * c * c;
+		a[2] = a0 - a1 * c + c * c;
 
 		// Normalise
 		for (int i = 0; i < 3; i++)
@@ -77,9 +86,16 @@ public:
 			b[i] /= a[0];
 			a[2-i] /= a[0];
 		}
+	}
 
-		// Set filter coefficients
-		filter.setCoefficients(IIRCoefficients(b[0], b[1], b[2], a[0], a[1], a[2]));
+	/*Normalised coefficients of the current tone setting: b0, b1, b2, a1, a2*/
+	void getCoefficients(temp* coefficients) const
+	{
+		coefficients[0] = b[0];
+		coefficients[1] = b[1];
+		coefficients[2] = b[2];
+		coefficients[3] = a[1];
+		coefficients[4] = a[2];
 	}
 
 	/*Process sample by sample*/
@@ -125,4 +141,59 @@ private:
 
 	IIRFilter filter;
 };
+
+template<class temp>
+
+/*
+Normalised tone biquad coefficients over the whole tone knob range, so the
+tone can be changed on the audio thread with a table look-up instead of the
+bilinear transform.
+
+The coefficients change fastest near both ends of the pot, where Rl or Rr
+goes to zero, so the grid is uniform in u with tone = 2u^2 below the middle
+and mirrored above it. Coefficients are interpolated linearly between the
+grid points. The stable region of (a1, a2) is convex, so every interpolated
+filter is stable.
+*/
+class TSToneTable
+{
+public:
+	/*Fills the table for a sample rate. Allocates, so call off the audio thread*/
+	void build(temp sampleRate, int segments = 256)
+	{
+		numSegments = segments;
+		coefficients.resize((size_t)(numSegments + 1) * 5);
+
+		TSTone<temp> tone;
+		tone.setSampleRate(sampleRate);
+		for (int i = 0; i <= numSegments; i++)
+		{
+			const temp u = (temp)i / (temp)numSegments;
+			tone.calculateCoefficients(u < 0.5 ? 2.0 * u * u : 1.0 - 2.0 * (1.0 - u) * (1.0 - u));
+			tone.getCoefficients(&coefficients[(size_t)i * 5]);
+		}
+	}
+
+	bool isEmpty() const { return coefficients.empty(); }
+
+	/*Coefficients b0, b1, b2, a1, a2 for a tone knob position 0 <= tone <= 1*/
+	void getCoefficients(temp tone, temp* out) const
+	{
+		tone = jlimit((temp)0.0, (temp)1.0, tone);
+		const temp u = tone < 0.5 ? std::sqrt((temp)0.5 * tone) : (temp)1.0 - std::sqrt((temp)0.5 * ((temp)1.0 - tone));
+		const temp x = u * (temp)numSegments;
+		const int i = jmin((int)x, numSegments - 1);
+		const temp frac = x - (temp)i;
+		const temp* c0 = &coefficients[(size_t)i * 5];
+		const temp* c1 = c0 + 5;
+
+		for (int k = 0; k < 5; k++)
+			out[k] = c0[k] + frac * (c1[k] - c0[k]);
+	}
+
+private:
+	int numSegments = 0;
+	std::vector<temp> coefficients;		// b0, b1, b2, a1, a2 per grid point
+};
+
 #endif // !TSTone_h
\ No newline at end of file
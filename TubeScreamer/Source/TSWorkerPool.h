@@ -0,0 +1,139 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TSWorkerPool_h
+#define TSWorkerPool_h
+#include "JuceHeader.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace juce;
+
+/*
+Fixed set of worker threads that share the tasks of one run() call with the
+calling thread.
+
+run() blocks until every task is done, so it is only for offline rendering.
+Tasks are claimed under a lock, which is cheap next to a channel group's
+worth of DSP and means a worker that wakes late can never pick up a task of
+a later call. One caller uses the pool at a time; another caller that finds
+it busy runs its tasks itself rather than waiting.
+*/
+class TSWorkerPool
+{
+public:
+	/*One worker per CPU besides the caller's*/
+	TSWorkerPool() : TSWorkerPool(SystemStats::getNumCpus() - 1) {}
+
+	explicit TSWorkerPool(int numWorkers)
+	{
+		for (int i = 0; i < numWorkers; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+
+	~TSWorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		wake.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	int getNumWorkers() const { return (int)workers.size(); }
+
+	/*Calls function(i) for 0 <= i < numTasks, spread over the workers and this thread*/
+	template <class Function>
+	void run(int numTasks, Function&& function)
+	{
+		std::unique_lock<std::mutex> caller(callerMutex, std::try_to_lock);
+		if (!caller.owns_lock() || workers.empty() || numTasks < 2)
+		{
+			for (int i = 0; i < numTasks; i++)
+				function(i);
+			return;
+		}
+
+		uint64 thisGeneration;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &function;
+			invoke = [](void* f, int i) { (*static_cast<std::remove_reference_t<Function>*>(f))(i); };
+			totalTasks = numTasks;
+			nextTask = 0;
+			remaining = numTasks;
+			thisGeneration = ++generation;
+		}
+
+		wake.notify_all();
+		runTasks(thisGeneration);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return remaining == 0; });
+		task = nullptr;
+	}
+
+private:
+	/*Claims and runs tasks of one call until there are none left*/
+	void runTasks(uint64 taskGeneration)
+	{
+		for (;;)
+		{
+			int i;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (generation != taskGeneration || nextTask >= totalTasks)
+					return;
+				i = nextTask++;
+			}
+
+			invoke(task, i);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--remaining == 0)
+				done.notify_all();
+		}
+	}
+
+	void workerLoop()
+	{
+		uint64 seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+
+			runTasks(seen);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex callerMutex;
+
+	// Current call, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	void* task = nullptr;
+	void (*invoke)(void*, int) = nullptr;
+	int totalTasks = 0;
+	int nextTask = 0;
+	int remaining = 0;
+	uint64 generation = 0;
+	bool stopping = false;
+};
+
+#endif // !TSWorkerPool_h
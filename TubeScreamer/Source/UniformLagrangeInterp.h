@@ -0,0 +1,136 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+#pragma once
+#ifndef UniformLagrangeInterp_h
+#define UniformLagrangeInterp_h
+#include <cstddef>
+template <class temp, int order = 3>
+
+/*
+Lagrange look-up on a uniformly spaced table.
+
+Gives the same result as LagrangeInterp for uniform grids, but the Lagrange
+polynomial of every cell is expanded into power-series coefficients when the
+table is made. A look-up is then one multiply, one truncation and a Horner
+evaluation, with no divisions and no writes.
+*/
+class UniformLagrangeInterp
+{
+public:
+	static_assert(order == 1 || order == 3 || order == 5, "Supported orders are 1, 3 and 5");
+
+	// coefficients per table cell
+	static constexpr int numCoeffs = order + 1;
+
+	/*Number of coefficients needed for a table of tableSize points*/
+	static size_t getNumCoefficients(size_t tableSize)
+	{
+		return (tableSize - 1) * numCoeffs;
+	}
+
+	/*
+	Computes the per-cell polynomial coefficients of uniformly spaced y-data.
+	coeffs must hold getNumCoefficients(tableSize) values. y may be of a wider
+	type than temp; the coefficients are worked out in double either way.
+	*/
+	template <class InputType>
+	static void makeCoefficients(const InputType* y, size_t tableSize, temp* coeffs)
+	{
+		const int L = (int)tableSize;
+
+		for (int cell = 0; cell < L - 1; cell++)
+		{
+			// Same nearest neighbours as LagrangeInterp, shifted inside the table at the edges
+			int first = cell + 1 - numCoeffs / 2;
+			if (first + order > L - 1)
+				first = L - 1 - order;
+			if (first < 0)
+				first = 0;
+
+			double c[numCoeffs] = {};
+
+			for (int i = 0; i < numCoeffs; i++)
+			{
+				// Basis polynomial of node i in the cell's local coordinate t
+				double basis[numCoeffs] = { 1.0 };
+				double denominator = 1.0;
+				int degree = 0;
+				const double xi = (double)(first + i - cell);
+
+				for (int j = 0; j < numCoeffs; j++)
+				{
+					if (j == i)
+						continue;
+
+					const double xj = (double)(first + j - cell);
+					degree++;
+					for (int k = degree; k > 0; k--)
+						basis[k] = basis[k - 1] - xj * basis[k];
+					basis[0] *= -xj;
+					denominator *= xi - xj;
+				}
+
+				for (int k = 0; k < numCoeffs; k++)
+					c[k] += (double)y[first + i] * basis[k] / denominator;
+			}
+
+			for (int k = 0; k < numCoeffs; k++)
+				coeffs[cell * numCoeffs + k] = (temp)c[k];
+		}
+	}
+
+	/*Points the interpolator at a coefficient table made for x-data from xMin to xMax*/
+	void setTable(temp xMin, temp xMax, size_t tableSize, const temp* coefficients)
+	{
+		x0 = xMin;
+		invDx = (temp)(tableSize - 1) / (xMax - xMin);
+		numCells = (int)tableSize - 1;
+		coeffs = coefficients;
+	}
+
+	/*Cell and local coordinate of a query sample*/
+	struct Position
+	{
+		int cell;
+		temp t;
+	};
+
+	/*Finds the cell of xq, clamped so that the edge cells extrapolate*/
+	inline Position locate(temp xq) const
+	{
+		const temp u = (xq - x0) * invDx;
+		const temp lastCell = (temp)(numCells - 1);
+		const int cell = (int)(u < 0 ? (temp)0 : (u > lastCell ? lastCell : u));
+		return { cell, u - (temp)cell };
+	}
+
+	/*Evaluates a coefficient table with the same grid at a located position*/
+	static inline temp evaluate(const temp* coefficients, Position pos)
+	{
+		const temp* c = coefficients + pos.cell * numCoeffs;
+
+		temp yq = c[order];
+		for (int k = order - 1; k >= 0; k--)
+			yq = yq * pos.t + c[k];
+
+		return yq;
+	}
+
+	/*Look-up function, xq - query sample*/
+	inline temp lookUp(temp xq) const
+	{
+		return evaluate(coeffs, locate(xq));
+	}
+
+private:
+	temp x0 = 0.0;				// first x-value
+	temp invDx = 1.0;			// reciprocal grid spacing
+	int numCells = 0;			// table size - 1
+	const temp* coeffs = nullptr;	// numCoeffs per cell
+};
+
+#endif // UniformLagrangeInterp_h
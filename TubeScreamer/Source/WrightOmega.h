@@ -0,0 +1,50 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef WrightOmega_h
+#define WrightOmega_h
+#include <cmath>
+
+template<class temp>
+
+/*
+Approximations of the Wright omega function, the solution w of w + ln(w) = x,
+after D'Angelo, Gabrielli and Turchet, "Fast Approximation of the Lambert W
+Function for Virtual Analog Modelling" (DAFx 2019).
+
+omega(x) = W(e^x), where W is the principal branch of Lambert W, so equations
+of the form y = q + c e^(y/a) can be solved without iterating.
+*/
+struct WrightOmega
+{
+	/*Cubic fit between x1 and x2, asymptotes outside. Absolute error below about 0.02*/
+	static inline temp omega3(temp x)
+	{
+		const temp x1 = -3.341459552768620;
+		const temp x2 = 8.0;
+		const temp a = -1.314293149877800e-3;
+		const temp b = 4.775931364975583e-2;
+		const temp c = 3.631952663804445e-1;
+		const temp d = 6.313183464296682e-1;
+
+		if (x < x1)
+			return 0.0;
+		if (x < x2)
+			return d + x * (c + x * (b + x * a));
+		return x - std::log(x);
+	}
+
+	/*omega3 refined by one Newton step on w + ln(w) - x*/
+	static inline temp omega4(temp x)
+	{
+		const temp w = omega3(x);
+		return w - (w - std::exp(x - w)) / (w + (temp)1.0);
+	}
+};
+
+#endif // !WrightOmega_h
@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef AliasBenchmark_h
+#define AliasBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+
+/*
+Alias rejection and cost of each anti-derivative anti-aliasing order at each
+oversampling factor, including the oversampling filters.
+*/
+namespace AliasBenchmark
+{
+	// FFT length at the base rate
+	constexpr int fftOrder = 16;
+	constexpr int fftSize = 1 << fftOrder;
+
+	/*Result of one (order, factor) run*/
+	struct Run
+	{
+		double aliasDb = 0.0;		// energy between the harmonics relative to the harmonics, 20 Hz - 20 kHz
+		double fundamental = 0.0;	// magnitude of the fundamental
+		double nsPerSample = 0.0;	// per base rate sample, oversampling included
+	};
+
+	/*
+	Runs a sine at the base rate through oversampling, the clipping stage and
+	downsampling, as the processor does. order 0 is the newton mode.
+	*/
+	template <template<class> class Clipping>
+	Run run(int order, int factor, double baseRate, double frequency, double distortion, int blockSize)
+	{
+		using Stage = TSClippingStage<double, Clipping>;
+		const double fs = baseRate * factor;
+
+		Stage stage;
+		if (order == 0)
+		{
+			stage.setSampleRate(fs);
+			stage.setSolver(Stage::Solver::wrightOmega);
+			stage.setProcessMode(Stage::ProcessMode::newton);
+		}
+		else
+		{
+			// the averaging of the linear part is matched at low frequencies at fs / 1.5 and fs / 2
+			stage.makeBoundedLookUpTable(order == 1 ? fs / 1.5 : fs / 2.0, 1.0e-5, 25, order);
+			stage.setProcessMode(order == 1 ? Stage::ProcessMode::antiAliased : Stage::ProcessMode::antiAliased2);
+		}
+		stage.setDistortion(distortion);
+
+		std::unique_ptr<dsp::Oversampling<float>> overSampling;
+		if (factor > 1)
+		{
+			overSampling = std::make_unique<dsp::Oversampling<float>>((size_t)1, (size_t)std::log2(factor),
+				dsp::Oversampling<float>::filterHalfBandFIREquiripple, true, false);
+			overSampling->initProcessing((size_t)blockSize);
+		}
+
+		// settle, then a whole number of blocks covering the FFT
+		const int settle = 8 * blockSize;
+		const int numSamples = settle + ((fftSize + blockSize - 1) / blockSize) * blockSize;
+		AudioBuffer<float> signal(1, numSamples);
+		for (int i = 0; i < numSamples; i++)
+			signal.setSample(0, i, 1.9f * (float)std::sin(MathConstants<double>::twoPi * frequency * i / baseRate));
+
+		const auto start = Time::getHighResolutionTicks();
+		for (int pos = 0; pos < numSamples; pos += blockSize)
+		{
+			float* channel = signal.getWritePointer(0, pos);
+			if (overSampling == nullptr)
+			{
+				stage.processBlock(channel, channel, blockSize);
+				continue;
+			}
+
+			dsp::AudioBlock<float> block(&channel, 1, (size_t)blockSize);
+			auto upsampled = overSampling->processSamplesUp(block);
+			float* up = upsampled.getChannelPointer(0);
+			stage.processBlock(up, up, (int)upsampled.getNumSamples());
+			overSampling->processSamplesDown(block);
+		}
+
+		Run result;
+		result.nsPerSample = 1.0e9 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) / numSamples;
+
+		// Windowed magnitude spectrum of the settled output
+		std::vector<float> spectrum(2 * fftSize, 0.0f);
+		std::copy(signal.getReadPointer(0, settle), signal.getReadPointer(0, settle) + fftSize, spectrum.begin());
+		dsp::WindowingFunction<float> window((size_t)fftSize, dsp::WindowingFunction<float>::blackmanHarris, false);
+		window.multiplyWithWindowingTable(spectrum.data(), (size_t)fftSize);
+		dsp::FFT(fftOrder).performFrequencyOnlyForwardTransform(spectrum.data());
+
+		// Bins within the window's main lobe of a harmonic count as harmonic
+		const double binWidth = baseRate / fftSize;
+		const double f0 = frequency / binWidth;
+		double harmonic = 0.0, alias = 0.0;
+
+		for (int k = (int)std::ceil(20.0 / binWidth); k * binWidth < 20000.0; k++)
+		{
+			const double power = (double)spectrum[(size_t)k] * spectrum[(size_t)k];
+			const double nearest = jmax(1.0, std::round(k / f0)) * f0;
+
+			if (std::abs(k - nearest) <= 8.0)
+				harmonic += power;
+			else
+				alias += power;
+		}
+
+		const int fundamentalBin = roundToInt(f0);
+		result.aliasDb = 10.0 * std::log10(jmax(alias, 1.0e-30) / harmonic);
+		result.fundamental = jmax((double)spectrum[(size_t)fundamentalBin - 1], (double)spectrum[(size_t)fundamentalBin], (double)spectrum[(size_t)fundamentalBin + 1]);
+		return result;
+	}
+
+	/*Every order and factor for one clipping type and frequency, with the fundamental compared to newton at the highest factor*/
+	template <template<class> class Clipping>
+	void runClipping(BenchmarkUtils::CsvWriter& csv, int clipType, double baseRate, double frequency, double distortion,
+		const std::vector<int>& factors, int blockSize)
+	{
+		const int highest = *std::max_element(factors.begin(), factors.end());
+		const auto reference = run<Clipping>(0, highest, baseRate, frequency, distortion, blockSize);
+
+		for (int order = 0; order < 3; order++)
+			for (int factor : factors)
+			{
+				const auto result = run<Clipping>(order, factor, baseRate, frequency, distortion, blockSize);
+				csv.writeLine(StringArray{ String(clipType), String(frequency, 1), String(factor), String(order),
+					String(result.aliasDb, 1), String(Decibels::gainToDecibels(result.fundamental / reference.fundamental), 2),
+					String(result.nsPerSample, 1) }.joinIntoString(","));
+			}
+	}
+
+	/*
+	Measures alias rejection, fundamental level error and cost for ADAA
+	orders 0-2 at each oversampling factor, for sines at the base rate.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double baseRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+		const double distortion = args.containsOption("--dist") ? args.getValueForOption("--dist").getDoubleValue() : 0.5;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+		const auto frequencies = BenchmarkUtils::parseList<double>(args.getValueForOption("--freqs"), { 1000.0, 2500.0, 5000.0 });
+		const auto factors = BenchmarkUtils::parseList<int>(args.getValueForOption("--factors"), { 1, 2, 4, 8 });
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("clip_type,frequency,oversampling,adaa_order,alias_db,fundamental_error_db,ns_per_sample");
+
+		for (auto frequency : frequencies)
+		{
+			// snap to a bin so the harmonics do not leak
+			const double binWidth = baseRate / fftSize;
+			const double f = std::round(frequency / binWidth) * binWidth;
+
+			runClipping<SymmetricClipping>(csv, 0, baseRate, f, distortion, factors, blockSize);
+			runClipping<AsymmetricClipping>(csv, 1, baseRate, f, distortion, factors, blockSize);
+		}
+	}
+}
+
+#endif // !AliasBenchmark_h
@@ -0,0 +1,366 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef BatchRender_h
+#define BatchRender_h
+#include "BenchmarkUtils.h"
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include "../../TubeScreamer/Source/TSClippingEngine.h"
+#include "../../TubeScreamer/Source/TSPostStage.h"
+#include "../../TubeScreamer/Source/TSWorkerPool.h"
+
+/*
+Re-amps many files through the pedal, one file per job, on every core.
+
+Each thread owns one clipping engine and output stage and keeps them between
+jobs, only rebuilding them for a new sample rate or channel count. The
+look-up tables for every input rate are built once before the threads start
+and shared through the table registry. Files are streamed a
+block at a time, so memory does not grow with file length. Jobs are dealt
+longest first to per-thread queues and idle threads steal from the back of
+the others' queues.
+*/
+namespace BatchRender
+{
+	/*One line of the job list*/
+	struct Job
+	{
+		File input, output;
+		float distortion = 0.5f;
+		float tone = 0.5f;
+		float level = 0.5f;
+		int clipType = 1;		// 0: symmetric, 1: asymmetric
+		bool aa = true;
+	};
+
+	/*Outcome of one job*/
+	struct Result
+	{
+		bool ok = false;
+		String error;
+		int64 channelSamples = 0;
+		double seconds = 0.0;
+		int thread = -1;
+	};
+
+	/*
+	Reads a job list: one job per line as
+	input, distortion, tone, level, clip_type, aa[, output]
+	Blank lines, lines starting with # and a header line are skipped. Fields
+	are taken by position, so a line with too few or too many, or an empty
+	one before output, is an error. Relative paths are relative to the list.
+	Without an output, or with an empty one, the job writes
+	<input name>_<line>.wav to outputDir.
+	*/
+	inline std::vector<Job> readJobs(const File& list, const File& outputDir)
+	{
+		StringArray lines;
+		list.readLines(lines);
+		std::vector<Job> jobs;
+
+		for (int line = 0; line < lines.size(); line++)
+		{
+			const String text = lines[line].trim();
+			if (text.isEmpty() || text.startsWithChar('#') || text.startsWithIgnoreCase("input,"))
+				continue;
+
+			auto fields = StringArray::fromTokens(text, ",", "\"");
+			fields.trim();
+			if (fields.size() < 6 || fields.size() > 7)
+				ConsoleApplication::fail("Job list line " + String(line + 1) + " needs 6 or 7 fields: " + text);
+
+			for (int field = 0; field < 6; field++)
+				if (fields[field].unquoted().isEmpty())
+					ConsoleApplication::fail("Job list line " + String(line + 1) + " has an empty field " + String(field + 1) + ": " + text);
+
+			Job job;
+			job.input = list.getParentDirectory().getChildFile(fields[0].unquoted());
+			job.distortion = fields[1].getFloatValue();
+			job.tone = fields[2].getFloatValue();
+			job.level = fields[3].getFloatValue();
+			job.clipType = fields[4].getIntValue();
+			job.aa = fields[5].getIntValue() != 0;
+			job.output = fields[6].unquoted().isNotEmpty() ? list.getParentDirectory().getChildFile(fields[6].unquoted())
+				: outputDir.getChildFile(job.input.getFileNameWithoutExtension() + "_" + String(line + 1) + ".wav");
+			jobs.push_back(job);
+		}
+
+		return jobs;
+	}
+
+	/*Distinct sample rates of the readable inputs of a job list*/
+	inline std::vector<double> getSampleRates(const std::vector<Job>& jobs)
+	{
+		AudioFormatManager formatManager;
+		formatManager.registerBasicFormats();
+		std::vector<double> rates;
+
+		for (const auto& job : jobs)
+		{
+			std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(job.input));
+			if (reader != nullptr && std::find(rates.begin(), rates.end(), reader->sampleRate) == rates.end())
+				rates.push_back(reader->sampleRate);
+		}
+
+		return rates;
+	}
+
+	/*
+	Per-thread queues of job indices. The owner takes from the front, where
+	the longest jobs are; thieves take from the back, the shortest, so late
+	in a batch no thread is left with one long job while the rest are idle.
+	Jobs are whole files, so a lock per queue costs nothing measurable.
+	*/
+	class WorkStealingQueue
+	{
+	public:
+		/*Deals the jobs round robin in the order given*/
+		WorkStealingQueue(int numThreads, const std::vector<int>& order)
+		{
+			for (int t = 0; t < numThreads; t++)
+				queues.push_back(std::make_unique<Queue>());
+
+			for (size_t i = 0; i < order.size(); i++)
+				queues[i % queues.size()]->jobs.push_back(order[i]);
+		}
+
+		/*Next job for a thread, its own or stolen. False when every queue is empty*/
+		bool next(int thread, int& job)
+		{
+			if (take(*queues[(size_t)thread], true, job))
+				return true;
+
+			for (size_t i = 1; i < queues.size(); i++)
+				if (take(*queues[((size_t)thread + i) % queues.size()], false, job))
+				{
+					steals++;
+					return true;
+				}
+
+			return false;
+		}
+
+		int getNumSteals() const { return steals.load(); }
+
+	private:
+		struct Queue
+		{
+			std::mutex lock;
+			std::deque<int> jobs;
+		};
+
+		static bool take(Queue& queue, bool front, int& job)
+		{
+			std::lock_guard<std::mutex> lock(queue.lock);
+			if (queue.jobs.empty())
+				return false;
+
+			job = front ? queue.jobs.front() : queue.jobs.back();
+			front ? queue.jobs.pop_front() : queue.jobs.pop_back();
+			return true;
+		}
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::atomic<int> steals{ 0 };
+	};
+
+	/*The DSP of one thread, reused from job to job*/
+	class Renderer
+	{
+	public:
+		Renderer(const TSClippingEngine::Settings& engineSettings, int maxBlockSize, double tableError)
+			: settings(engineSettings), blockSize(maxBlockSize), error(tableError)
+		{
+			formatManager.registerBasicFormats();
+		}
+
+		/*
+		Renders a job to a 24-bit WAV file at the input's rate and channel
+		count, with the oversampling latency removed so the output lines up
+		with the input.
+		*/
+		Result render(const Job& job)
+		{
+			Result result;
+			const auto start = Time::getHighResolutionTicks();
+
+			std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(job.input));
+			if (reader == nullptr)
+			{
+				result.error = "could not read input";
+				return result;
+			}
+
+			const int numChannels = (int)reader->numChannels;
+			prepare(reader->sampleRate, numChannels);
+
+			job.output.getParentDirectory().createDirectory();
+			job.output.deleteFile();
+			WavAudioFormat wav;
+			std::unique_ptr<AudioFormatWriter> writer(wav.createWriterFor(job.output.createOutputStream().release(),
+				reader->sampleRate, (unsigned int)numChannels, 24, {}, 0));
+
+			if (writer == nullptr)
+			{
+				result.error = "could not write output";
+				return result;
+			}
+
+			// Fixed settings for the whole file, mapped as the plugin maps its knobs
+			SmoothedValue<float> distortion, tone, level;
+			distortion.setCurrentAndTargetValue(job.distortion);
+			tone.setCurrentAndTargetValue(std::sqrt(job.tone));
+			level.setCurrentAndTargetValue(job.level);
+			postStage.setTone(tone.getTargetValue());
+
+			const int64 length = reader->lengthInSamples;
+			const int latency = engine->getLatencySamples();
+			TSSolverCounts counts;
+
+			// Latency's worth of silence after the file flushes the filters
+			for (int64 pos = 0; pos < length + latency; pos += blockSize)
+			{
+				const int n = (int)jmin((int64)blockSize, length + latency - pos);
+				buffer.setSize(numChannels, n, false, false, true);
+				buffer.clear();
+
+				if (pos < length)
+					reader->read(&buffer, 0, (int)jmin((int64)n, length - pos), pos, true, true);
+
+				AudioBlock<float> block(buffer);
+				engine->process(block, job.aa, job.clipType < 1, distortion, counts);
+				postStage.process(buffer.getArrayOfWritePointers(), numChannels, n, level, tone);
+
+				const int skip = (int)jlimit((int64)0, (int64)n, latency - pos);
+				if (!writer->writeFromAudioSampleBuffer(buffer, skip, n - skip))
+				{
+					result.error = "write failed";
+					return result;
+				}
+			}
+
+			result.ok = true;
+			result.channelSamples = length * numChannels;
+			result.seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+			return result;
+		}
+
+	private:
+		/*Builds the DSP for a new rate or channel count, otherwise clears its state*/
+		void prepare(double sampleRate, int numChannels)
+		{
+			if (engine != nullptr && sampleRate == preparedRate && numChannels == preparedChannels)
+			{
+				engine->reset();
+				postStage.reset();
+				return;
+			}
+
+			engine = std::make_unique<TSClippingEngine>(settings, sampleRate, blockSize, numChannels, error, 0.5, true);
+			postStage.prepare((float)sampleRate, blockSize, numChannels);
+			preparedRate = sampleRate;
+			preparedChannels = numChannels;
+		}
+
+		TSClippingEngine::Settings settings;
+		const int blockSize;
+		const double error;
+
+		AudioFormatManager formatManager;
+		std::unique_ptr<TSClippingEngine> engine;
+		TSPostStage<float> postStage;
+		AudioBuffer<float> buffer;
+		double preparedRate = 0.0;
+		int preparedChannels = 0;
+	};
+
+	/*
+	Renders every job of a list across all cores and reports throughput in
+	channel samples per second per thread.
+	*/
+	inline void batch(const ArgumentList& args)
+	{
+		args.checkMinNumArguments(3);
+		const File list = args[1].resolveAsFile();
+		const File outputDir = args[2].resolveAsFile();
+
+		if (!list.existsAsFile())
+			ConsoleApplication::fail("Job list not found: " + list.getFullPathName());
+
+		TSClippingEngine::Settings settings;
+		settings.factorLog2 = roundToInt(std::log2(args.containsOption("--os") ? args.getValueForOption("--os").getIntValue() : 2));
+		settings.filterType = args.containsOption("--os-filter") ? args.getValueForOption("--os-filter").getIntValue() : 0;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 4096;
+		const int numThreads = jmax(1, args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue()
+			: SystemStats::getNumCpus());
+
+		const auto jobs = readJobs(list, outputDir);
+		if (jobs.empty())
+			ConsoleApplication::fail("No jobs in " + list.getFullPathName());
+
+		// Longest first, by file size
+		std::vector<int> order((size_t)jobs.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return jobs[(size_t)a].input.getSize() > jobs[(size_t)b].input.getSize(); });
+
+		// The registry builds outside its lock, so threads starting together would
+		// each build the same tables. Build them here, and keep them alive until
+		// the batch is done, so every thread's engine finds them in the registry
+		const double tableError = 1.0e-5;
+		std::vector<std::unique_ptr<TSClippingEngine>> tableOwners;
+		for (double rate : getSampleRates(jobs))
+			tableOwners.push_back(std::make_unique<TSClippingEngine>(settings, rate, blockSize, 1, tableError, 0.5, true));
+
+		WorkStealingQueue queue(numThreads, order);
+		std::vector<Result> results(jobs.size());
+		std::atomic<int> numDone{ 0 };
+		TSWorkerPool pool(numThreads - 1);
+
+		const auto start = Time::getHighResolutionTicks();
+		pool.run(numThreads, [&](int thread)
+		{
+			Renderer renderer(settings, blockSize, tableError);
+			int job;
+			while (queue.next(thread, job))
+			{
+				results[(size_t)job] = renderer.render(jobs[(size_t)job]);
+				results[(size_t)job].thread = thread;
+
+				const int done = ++numDone;
+				if (!results[(size_t)job].ok)
+					std::cerr << jobs[(size_t)job].input.getFullPathName() << ": " << results[(size_t)job].error << std::endl;
+				else if (done % 100 == 0)
+					std::cerr << done << " / " << jobs.size() << " jobs" << std::endl;
+			}
+		});
+		const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("input,output,status,thread,channel_samples,seconds,samples_per_s");
+
+		int64 totalSamples = 0;
+		int numFailed = 0;
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			const auto& r = results[i];
+			totalSamples += r.channelSamples;
+			numFailed += r.ok ? 0 : 1;
+			csv.writeLine(StringArray{ jobs[i].input.getFullPathName().quoted(), jobs[i].output.getFullPathName().quoted(),
+				r.ok ? String("ok") : r.error, String(r.thread), String(r.channelSamples), String(r.seconds, 3),
+				String(r.seconds > 0.0 ? (double)r.channelSamples / r.seconds : 0.0, 0) }.joinIntoString(","));
+		}
+
+		std::cerr << "Rendered " << (int)jobs.size() - numFailed << " of " << (int)jobs.size() << " jobs on " << numThreads
+			<< " threads in " << seconds << " s, " << queue.getNumSteals() << " stolen: "
+			<< (double)totalSamples / seconds / numThreads << " channel samples per second per core" << std::endl;
+	}
+}
+
+#endif // !BatchRender_h
@@ -0,0 +1,148 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef BenchmarkUtils_h
+#define BenchmarkUtils_h
+#include <JuceHeader.h>
+#include <algorithm>
+#include <vector>
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+using namespace juce;
+
+/*
+Helpers shared by the headless benchmarks: timing, test signals and CSV output.
+*/
+namespace BenchmarkUtils
+{
+	/*Reads the CPU timestamp counter, or 0 where none is available*/
+	inline uint64 readCycleCounter() noexcept
+	{
+	   #if JUCE_INTEL
+		return (uint64)__rdtsc();
+	   #else
+		return 0;
+	   #endif
+	}
+
+	/*Returns the q-th percentile (0 <= q <= 1) of a set of samples*/
+	inline double percentile(std::vector<double> values, double q)
+	{
+		if (values.empty())
+			return 0.0;
+
+		std::sort(values.begin(), values.end());
+		const auto index = (size_t)jlimit(0.0, (double)(values.size() - 1), q * (double)(values.size() - 1) + 0.5);
+		return values[index];
+	}
+
+	/*
+	Creates a test signal of the given length.
+	source - "sine", "noise" or the path of an audio file (looped to length)
+	*/
+	inline AudioBuffer<float> makeTestSignal(const String& source, double sampleRate, int numChannels, double seconds)
+	{
+		const int numSamples = jmax(1, roundToInt(seconds * sampleRate));
+		AudioBuffer<float> signal(numChannels, numSamples);
+		signal.clear();
+
+		if (source == "sine" || source.isEmpty())
+		{
+			const double delta = MathConstants<double>::twoPi * 220.0 / sampleRate;
+			for (int ch = 0; ch < numChannels; ch++)
+				for (int i = 0; i < numSamples; i++)
+					signal.setSample(ch, i, 0.5f * (float)std::sin(delta * i + 0.25 * ch));
+		}
+		else if (source == "noise")
+		{
+			Random random(1234);
+			for (int ch = 0; ch < numChannels; ch++)
+				for (int i = 0; i < numSamples; i++)
+					signal.setSample(ch, i, 0.5f * (2.0f * random.nextFloat() - 1.0f));
+		}
+		else
+		{
+			AudioFormatManager formatManager;
+			formatManager.registerBasicFormats();
+			std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(File::getCurrentWorkingDirectory().getChildFile(source)));
+
+			if (reader == nullptr)
+				ConsoleApplication::fail("Could not read audio file: " + source);
+
+			AudioBuffer<float> file((int)reader->numChannels, (int)reader->lengthInSamples);
+			reader->read(&file, 0, file.getNumSamples(), 0, true, true);
+
+			// loop the file to the requested length, duplicating the last channel if needed
+			for (int ch = 0; ch < numChannels; ch++)
+			{
+				const int srcCh = jmin(ch, file.getNumChannels() - 1);
+				for (int pos = 0; pos < numSamples; pos += file.getNumSamples())
+					signal.copyFrom(ch, pos, file, srcCh, 0, jmin(file.getNumSamples(), numSamples - pos));
+			}
+		}
+
+		return signal;
+	}
+
+	/*Parses a comma separated list of numbers, or returns the defaults if empty*/
+	template <class temp>
+	std::vector<temp> parseList(const String& text, std::vector<temp> defaults)
+	{
+		if (text.isEmpty())
+			return defaults;
+
+		std::vector<temp> values;
+		for (auto& token : StringArray::fromTokens(text, ",", {}))
+			values.push_back((temp)token.trim().getDoubleValue());
+
+		return values;
+	}
+
+	/*Writes CSV lines to a file, or to stdout if no file is given*/
+	class CsvWriter
+	{
+	public:
+		CsvWriter(const String& path)
+		{
+			if (path.isNotEmpty())
+			{
+				File file = File::getCurrentWorkingDirectory().getChildFile(path);
+				file.deleteFile();
+				stream = file.createOutputStream();
+
+				if (stream == nullptr)
+					ConsoleApplication::fail("Could not write to: " + path);
+			}
+		}
+
+		void writeLine(const String& line)
+		{
+			if (stream != nullptr)
+			{
+				stream->writeText(line + "\n", false, false, nullptr);
+				stream->flush();
+			}
+			else
+			{
+				std::cout << line << std::endl;
+			}
+		}
+
+	private:
+		std::unique_ptr<FileOutputStream> stream;
+	};
+}
+
+#endif // !BenchmarkUtils_h
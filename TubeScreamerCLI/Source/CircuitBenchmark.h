@@ -0,0 +1,116 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef CircuitBenchmark_h
+#define CircuitBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+#include "../../TubeScreamer/Source/TS808FatCircuit.h"
+#include <complex>
+
+/*
+Small-signal response of the generated circuits, checked against the
+analytic response of their netlists. At low levels the diodes barely
+conduct and the stage is the non-inverting gain 1 + Zf / Zg after the
+C1 / R1 high-pass, with Zf = RV2 || C2 and Zg = R3 + C3.
+*/
+namespace CircuitBenchmark
+{
+	// Diode parameters, set on the stages so the expected response can include their small-signal conductance
+	constexpr double Is = 2.52e-9;
+	constexpr double Vt = 25.85e-3;
+	constexpr double Ni = 1.752;
+
+	// Input level, low enough that the diodes stay linear
+	constexpr double level = 1.0e-4;
+
+	/*Component values of Tools/Circuits/TS808.cir and TS808Fat.cir*/
+	struct Components
+	{
+		double C1 = 1.0e-6, R1 = 10.0e3, R3 = 4.7e3, C2 = 51.0e-12, C3 = 47.0e-9;
+	};
+
+	/*Analytic gain of the netlist at a frequency, with the diode pair as its small-signal conductance*/
+	template <class Circuit>
+	double expectedGain(const Components& c, double distortion, double frequency)
+	{
+		using Complex = std::complex<double>;
+		const Complex s(0.0, MathConstants<double>::twoPi * frequency);
+		const double RV2 = Circuit::potFixed + distortion * Circuit::potRange;
+		const double diode = SymmetricClipping<double>::dfunc(0.0, 1.0, Is, Vt, Ni) + 1.0;
+
+		const Complex highPass = s * c.R1 * c.C1 / (1.0 + s * c.R1 * c.C1);
+		const Complex Zf = 1.0 / (1.0 / RV2 + s * c.C2 + diode);
+		const Complex Zg = c.R3 + 1.0 / (s * c.C3);
+		return std::abs(highPass * (1.0 + Zf / Zg));
+	}
+
+	/*Gain of a settled sine through the stage in newton mode, from a single DFT bin over whole periods*/
+	template <class Circuit>
+	double measuredGain(double sampleRate, double distortion, double frequency)
+	{
+		using Stage = TSClippingStage<double, SymmetricClipping, 3, double, Circuit>;
+
+		Stage stage;
+		stage.setSampleRate(sampleRate);
+		stage.setDiodeParameters(Is, Vt, Ni);
+		stage.setProcessMode(Stage::ProcessMode::newton);
+		stage.setDistortion(distortion);
+
+		// settle well past the C1 / R1 time constant, then whole periods covering at least 0.1 s
+		const int settle = roundToInt(0.5 * sampleRate);
+		const int periods = jmax(1, (int)std::ceil(0.1 * frequency));
+		const int measured = roundToInt(periods * sampleRate / frequency);
+		const double delta = MathConstants<double>::twoPi * frequency / sampleRate;
+
+		std::vector<double> signal((size_t)(settle + measured));
+		for (size_t i = 0; i < signal.size(); i++)
+			signal[i] = level * std::sin(delta * (double)i);
+
+		stage.processBlock(signal.data(), signal.data(), (int)signal.size());
+
+		std::complex<double> bin;
+		for (int i = 0; i < measured; i++)
+			bin += signal[(size_t)(settle + i)] * std::polar(1.0, -delta * (settle + i));
+
+		return 2.0 * std::abs(bin) / (measured * level);
+	}
+
+	/*
+	Compares TS808Circuit and TS808FatCircuit with their netlists over a sweep
+	of low frequencies, including the change the larger C3 makes to the
+	bass roll-off of the gain.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 96000.0;
+		const auto distortions = BenchmarkUtils::parseList<double>(args.getValueForOption("--dists"), { 0.0, 0.5, 1.0 });
+		const auto frequencies = BenchmarkUtils::parseList<double>(args.getValueForOption("--freqs"), { 50.0, 100.0, 200.0, 400.0, 800.0, 1600.0, 3200.0 });
+
+		Components ts808;
+		Components fat;
+		fat.C3 = 100.0e-9;
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("distortion,frequency,ts808_db,ts808_expected_db,fat_db,fat_expected_db,difference_db,expected_difference_db");
+
+		for (auto distortion : distortions)
+			for (auto frequency : frequencies)
+			{
+				const double gain = Decibels::gainToDecibels(measuredGain<TS808Circuit>(sampleRate, distortion, frequency));
+				const double expected = Decibels::gainToDecibels(expectedGain<TS808Circuit>(ts808, distortion, frequency));
+				const double fatGain = Decibels::gainToDecibels(measuredGain<TS808FatCircuit>(sampleRate, distortion, frequency));
+				const double fatExpected = Decibels::gainToDecibels(expectedGain<TS808FatCircuit>(fat, distortion, frequency));
+
+				csv.writeLine(StringArray{ String(distortion, 2), String(frequency, 1), String(gain, 3), String(expected, 3),
+					String(fatGain, 3), String(fatExpected, 3), String(fatGain - gain, 3), String(fatExpected - expected, 3) }.joinIntoString(","));
+			}
+	}
+}
+
+#endif // !CircuitBenchmark_h
@@ -0,0 +1,153 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef ClipperBenchmark_h
+#define ClipperBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+
+/*
+Throughput of TSClippingStage on its own, at the oversampled rate.
+*/
+namespace ClipperBenchmark
+{
+	using SymmetricStage = TSClippingStage<double, SymmetricClipping>;
+	using AsymmetricStage = TSClippingStage<double, AsymmetricClipping>;
+
+	/*Builds a stage for an oversampled rate, as the processor does*/
+	template <class Stage>
+	std::unique_ptr<Stage> makeStage(bool aa, double fs, int numChannels)
+	{
+		auto stage = std::make_unique<Stage>();
+		if (aa)
+			stage->makeBoundedLookUpTable(fs / 1.5, 1.0e-5);
+		else
+			stage->setSampleRate(fs);
+
+		stage->setDistortion(0.5);
+		stage->setNumChannels(numChannels);
+		stage->setProcessMode(aa ? Stage::ProcessMode::antiAliased : Stage::ProcessMode::newton);
+		return stage;
+	}
+
+	/*
+	Per-sample loop as processBlock used to run it: mode atomics read,
+	stage picked and output level applied for every oversampled sample.
+	*/
+	inline double runPerSample(SymmetricStage& symm, AsymmetricStage& asymm, bool aa, bool isSymm, AudioBuffer<float>& signal, int blockSize)
+	{
+		std::atomic<float> isAa{ aa ? 1.0f : 0.0f };
+		std::atomic<float> clipType{ isSymm ? 0.0f : 1.0f };
+		SmoothedValue<float> level;
+		level.reset(48000.0, 0.01);
+		level.setCurrentAndTargetValue(0.5f);
+
+		const int numChannels = signal.getNumChannels();
+		std::vector<double> frame((size_t)numChannels);
+		const auto start = Time::getHighResolutionTicks();
+
+		for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+		{
+			const int n = jmin(blockSize, signal.getNumSamples() - pos);
+			for (int i = pos; i < pos + n; i++)
+			{
+				for (int ch = 0; ch < numChannels; ch++)
+					frame[ch] = signal.getSample(ch, i);
+
+				if ((int)isAa.load())
+				{
+					if ((int)clipType.load() < 1)
+						symm.antiAliasedProcess(frame.data(), frame.data());
+					else
+						asymm.antiAliasedProcess(frame.data(), frame.data());
+				}
+				else
+				{
+					if ((int)clipType.load() < 1)
+						symm.process(frame.data(), frame.data(), false);
+					else
+						asymm.process(frame.data(), frame.data(), false);
+				}
+
+				const float gain = level.getNextValue();
+				for (int ch = 0; ch < numChannels; ch++)
+					signal.setSample(ch, i, (float)frame[ch] * gain);
+			}
+		}
+
+		return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+	}
+
+	/*Block loop: mode picked once, tight inner loop, gain in a separate pass*/
+	template <class Stage>
+	double runBlock(Stage& stage, AudioBuffer<float>& signal, int blockSize)
+	{
+		SmoothedValue<float> level;
+		level.reset(48000.0, 0.01);
+		level.setCurrentAndTargetValue(0.5f);
+
+		const int numChannels = signal.getNumChannels();
+		std::vector<float*> channels((size_t)numChannels);
+		const auto start = Time::getHighResolutionTicks();
+
+		for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+		{
+			const int n = jmin(blockSize, signal.getNumSamples() - pos);
+			for (int ch = 0; ch < numChannels; ch++)
+				channels[ch] = signal.getWritePointer(ch, pos);
+
+			stage.processBlock(channels.data(), channels.data(), numChannels, n);
+
+			AudioBuffer<float> view(channels.data(), numChannels, n);
+			level.applyGain(view, n);
+		}
+
+		return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+	}
+
+	/*
+	Compares per-sample and block processing at 2x, 4x and 8x oversampling of a 48 kHz stream.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double baseRate = 48000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 1.0;
+		const int numChannels = args.containsOption("--channels") ? args.getValueForOption("--channels").getIntValue() : 2;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("aa,clip_type,oversampling,channels,per_sample_msamples_per_s,block_msamples_per_s,speedup");
+
+		for (int aa = 0; aa < 2; aa++)
+			for (int clipType = 0; clipType < 2; clipType++)
+				for (int factor : { 2, 4, 8 })
+				{
+					const double fs = baseRate * factor;
+					const int osBlock = blockSize * factor;
+					auto symm = makeStage<SymmetricStage>(aa != 0, fs, numChannels);
+					auto asymm = makeStage<AsymmetricStage>(aa != 0, fs, numChannels);
+
+					auto signal = BenchmarkUtils::makeTestSignal("sine", fs, numChannels, seconds);
+					signal.applyGain(0.95f);
+					const double perSample = runPerSample(*symm, *asymm, aa != 0, clipType == 0, signal, osBlock);
+
+					symm->reset();
+					asymm->reset();
+					signal = BenchmarkUtils::makeTestSignal("sine", fs, numChannels, seconds);
+					signal.applyGain(0.95f);
+					const double block = clipType == 0 ? runBlock(*symm, signal, osBlock) : runBlock(*asymm, signal, osBlock);
+
+					const double numSamples = (double)signal.getNumSamples() * numChannels;
+					csv.writeLine(StringArray{ String(aa), String(clipType), String(factor), String(numChannels),
+						String(numSamples / perSample * 1.0e-6, 3), String(numSamples / block * 1.0e-6, 3),
+						String(perSample / block, 3) }.joinIntoString(","));
+				}
+	}
+}
+
+#endif // !ClipperBenchmark_h
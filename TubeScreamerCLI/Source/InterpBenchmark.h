@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef InterpBenchmark_h
+#define InterpBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/LagrangeInterp.h"
+#include "../../TubeScreamer/Source/UniformLagrangeInterp.h"
+
+/*
+LagrangeInterp against UniformLagrangeInterp on a clipping-stage sized table.
+*/
+namespace InterpBenchmark
+{
+	/*Times both interpolators of one order and writes a CSV row*/
+	template <int order>
+	void run(BenchmarkUtils::CsvWriter& csv, const std::vector<double>& x, const std::vector<double>& y,
+		const std::vector<double>& queries)
+	{
+		const size_t N = x.size();
+
+		LagrangeInterp<double> general(order);
+		general.setTableSize(N);
+
+		std::vector<double> coeffs(UniformLagrangeInterp<double, order>::getNumCoefficients(N));
+		UniformLagrangeInterp<double, order>::makeCoefficients(y.data(), N, coeffs.data());
+		UniformLagrangeInterp<double, order> uniform;
+		uniform.setTable(x.front(), x.back(), N, coeffs.data());
+
+		double sumGeneral = 0.0, sumUniform = 0.0, maxError = 0.0;
+
+		auto start = Time::getHighResolutionTicks();
+		for (auto q : queries)
+			sumGeneral += general.lookUp(const_cast<double*>(x.data()), const_cast<double*>(y.data()), q);
+		const double generalSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+		start = Time::getHighResolutionTicks();
+		for (auto q : queries)
+			sumUniform += uniform.lookUp(q);
+		const double uniformSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+		for (size_t i = 0; i < queries.size(); i += 97)
+			maxError = jmax(maxError, std::abs(general.lookUp(const_cast<double*>(x.data()), const_cast<double*>(y.data()), queries[i])
+				- uniform.lookUp(queries[i])));
+
+		const double n = (double)queries.size();
+		csv.writeLine(StringArray{ String(order), String(N), String(1.0e9 * generalSeconds / n, 3),
+			String(1.0e9 * uniformSeconds / n, 3), String(generalSeconds / uniformSeconds, 3),
+			String(maxError), String(sumGeneral - sumUniform) }.joinIntoString(","));
+	}
+
+	/*
+	Looks up random queries in a 32768 point table over [-50, 50] with orders 1, 3 and 5.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const int numPoints = args.containsOption("--points") ? args.getValueForOption("--points").getIntValue() : 32768;
+		const int numQueries = args.containsOption("--queries") ? args.getValueForOption("--queries").getIntValue() : 4000000;
+
+		std::vector<double> x((size_t)numPoints), y((size_t)numPoints), queries((size_t)numQueries);
+		for (int i = 0; i < numPoints; i++)
+		{
+			x[i] = -50.0 + 100.0 * i / (numPoints - 1);
+			y[i] = std::tanh(x[i]) + 0.01 * x[i];
+		}
+
+		Random random(42);
+		for (auto& q : queries)
+			q = -50.0 + 100.0 * random.nextDouble();
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("order,table_size,lagrange_ns,uniform_ns,speedup,max_abs_difference,checksum_difference");
+		run<1>(csv, x, y, queries);
+		run<3>(csv, x, y, queries);
+		run<5>(csv, x, y, queries);
+	}
+}
+
+#endif // !InterpBenchmark_h
@@ -0,0 +1,130 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+/*
+  ==============================================================================
+
+    Headless command line front end for rendering and benchmarking the
+    Tube Screamer model without a plugin host.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "ProcessorBenchmark.h"
+#include "ClipperBenchmark.h"
+#include "InterpBenchmark.h"
+#include "PrecisionBenchmark.h"
+#include "TableBenchmark.h"
+#include "SolverBenchmark.h"
+#include "AliasBenchmark.h"
+#include "PostStageBenchmark.h"
+#include "CircuitBenchmark.h"
+#include "BatchRender.h"
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand ("--help|-h", "Usage:", true);
+
+    app.addCommand ({ "--render",
+                      "--render <input.wav|sine|noise> <output.wav> [--dist=0.5] [--tone=0.5] [--level=0.5] [--aa=1] [--clip=1] [--os=2] [--os-filter=0] [--channels=2] [--rate=48000] [--block=512] [--seconds=5]",
+                      "Renders an input through the full processor chain to a WAV file.",
+                      "Audio files are processed at their own sample rate and channel count (at least 2) unless --channels is given. The rate and length options only apply to generated signals.\n"
+                      "--os is the oversampling factor (1-16), --os-filter 0 for linear phase FIR or 1 for polyphase IIR. The output is not latency compensated.",
+                      [] (const juce::ArgumentList& args) { ProcessorBenchmark::render (args); } });
+
+    app.addCommand ({ "--batch",
+                      "--batch <jobs.csv> <output dir> [--csv=report.csv] [--threads=<cores>] [--os=2] [--os-filter=0] [--block=4096]",
+                      "Re-amps every job of a list in parallel on all cores.",
+                      "Each line of the list is: input, distortion, tone, level, clip_type, aa[, output]. Outputs are 24-bit WAV files at the\n"
+                      "input's rate and channel count, latency compensated. Writes one CSV row per job and prints throughput per core.",
+                      [] (const juce::ArgumentList& args) { BatchRender::batch (args); } });
+
+    app.addCommand ({ "--bench",
+                      "--bench [--csv=results.csv] [--input=sine|noise|file.wav] [--seconds=2] [--rates=44100,...] [--blocks=16,...] [--label=name]",
+                      "Measures realtime factor, block latency and cycles per sample for every aa / clip_type combination.",
+                      "Writes one CSV row per (aa, clip_type, sample rate, block size). Cycles are timestamp-counter cycles.",
+                      [] (const juce::ArgumentList& args) { ProcessorBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-channels",
+                      "--bench-channels [--csv=results.csv] [--channels=1,2,6,8,12,16] [--input=sine|noise|file.wav] [--rate=48000] [--block=512] [--seconds=2]",
+                      "Measures how wide buses scale when channel groups run on the worker pool offline.",
+                      "Reports realtime factor live (groups in turn) and offline (groups in parallel), and the largest difference between the two.",
+                      [] (const juce::ArgumentList& args) { ProcessorBenchmark::channels (args); } });
+
+    app.addCommand ({ "--bench-switch",
+                      "--bench-switch [--csv=results.csv] [--factors=1,2,4,8] [--blocks=64,256,1024] [--input=sine|noise|file.wav] [--rate=48000] [--seconds=2]",
+                      "Measures the worst-case block time while aa and clip_type switch, against steady playback.",
+                      "Blocks within the warm-up and crossfade of a switch are timed apart from the rest. Switches cycle through all four modes.",
+                      [] (const juce::ArgumentList& args) { ProcessorBenchmark::switching (args); } });
+
+    app.addCommand ({ "--bench-clipper",
+                      "--bench-clipper [--csv=results.csv] [--seconds=1] [--channels=2] [--block=512]",
+                      "Compares per-sample and block processing of TSClippingStage at 2x/4x/8x oversampling.",
+                      "Reports throughput in millions of channel samples per second at the oversampled rate.",
+                      [] (const juce::ArgumentList& args) { ClipperBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-interp",
+                      "--bench-interp [--csv=results.csv] [--points=32768] [--queries=4000000]",
+                      "Compares LagrangeInterp with UniformLagrangeInterp at orders 1, 3 and 5.",
+                      "Reports nanoseconds per look-up and the largest difference between the two.",
+                      [] (const juce::ArgumentList& args) { InterpBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-precision",
+                      "--bench-precision [--csv=results.csv] [--input=sine,noise] [--rate=96000] [--seconds=1] [--channels=2] [--block=1024]",
+                      "Compares float-table and float TSClippingStage configurations against the double stage.",
+                      "Reports table size, largest and RMS error (relative to the double output) and throughput for every mode.",
+                      [] (const juce::ArgumentList& args) { PrecisionBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-table",
+                      "--bench-table [--csv=results.csv] [--errors=0,1e-4,...] [--rates=88200,...] [--input=sine|noise|file.wav] [--seconds=0.5]",
+                      "Reports size, range, error and build time of clipping stage look-up tables.",
+                      "A target error of 0 builds the uniform 4096 point table. Output error is measured against the Newton solver.",
+                      [] (const juce::ArgumentList& args) { TableBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-solver",
+                      "--bench-solver [--csv=results.csv] [--input=sine,noise] [--rate=96000] [--seconds=1] [--block=1024]",
+                      "Compares the capped Newton, damped Newton and explicit Wright omega solvers of TSClippingStage.",
+                      "Reports the largest output difference from capped Newton, throughput and speedup over capped Newton.",
+                      [] (const juce::ArgumentList& args) { SolverBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--solver-stats",
+                      "--solver-stats [--csv=results.csv] [--input=sine|noise|file.wav] [--dists=0,0.25,...] [--levels=0.1,0.5,...] [--rate=96000] [--seconds=1] [--block=1024]",
+                      "Dumps TSClippingStage solver counts for every solver over a grid of Drive settings and input levels.",
+                      "Reports iterations, damping sub-iterations, cap hits and non-converged solves per solve, with block time percentiles.",
+                      [] (const juce::ArgumentList& args) { SolverBenchmark::stats (args); } });
+
+    app.addCommand ({ "--bench-alias",
+                      "--bench-alias [--csv=results.csv] [--freqs=1000,2500,5000] [--factors=1,2,4,8] [--rate=48000] [--dist=0.5] [--block=512]",
+                      "Measures alias rejection and cost of the clipping stage for ADAA orders 0, 1 and 2 at each oversampling factor.",
+                      "Cost includes the oversampling filters. Fundamental error is relative to the newton mode at the highest factor.",
+                      [] (const juce::ArgumentList& args) { AliasBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-post",
+                      "--bench-post [--csv=results.csv] [--input=sine|noise|file.wav] [--seconds=10] [--rate=48000] [--channels=2] [--blocks=512,...]",
+                      "Compares the level, tone and DC block as separate passes against the fused output stage.",
+                      "Reports nanoseconds per channel sample and the largest output difference.",
+                      [] (const juce::ArgumentList& args) { PostStageBenchmark::benchmark (args); } });
+
+    app.addCommand ({ "--bench-tone",
+                      "--bench-tone [--csv=results.csv] [--rates=44100,...] [--segments=64,128,256,512]",
+                      "Compares tone coefficient updates through the bilinear transform against the precomputed tone table.",
+                      "Reports nanoseconds per update and the table's largest magnitude response error over the knob range.",
+                      [] (const juce::ArgumentList& args) { PostStageBenchmark::toneUpdates (args); } });
+
+    app.addCommand ({ "--bench-circuit",
+                      "--bench-circuit [--csv=results.csv] [--dists=0,0.5,1] [--freqs=50,100,...] [--rate=96000]",
+                      "Checks the small-signal response of the TS808 and TS808Fat circuits against their netlists.",
+                      "Reports measured and expected gain of each circuit and the difference the 100n capacitor makes, in dB.",
+                      [] (const juce::ArgumentList& args) { CircuitBenchmark::benchmark (args); } });
+
+    return app.findAndRunCommand (argc, argv);
+}
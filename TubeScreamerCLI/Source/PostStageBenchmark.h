@@ -0,0 +1,195 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef PostStageBenchmark_h
+#define PostStageBenchmark_h
+#include "BenchmarkUtils.h"
+#include <complex>
+#include "../../TubeScreamer/Source/TSPostStage.h"
+
+/*
+Cost of the base rate output stage: level, tone and DC block as separate
+passes against the fused TSPostStage, and tone coefficient updates through
+TSTone against TSToneTable.
+*/
+namespace PostStageBenchmark
+{
+	/*Level, tone and high pass as processBlock used to run them, one pass each*/
+	inline double runSeparate(AudioBuffer<float>& signal, double fs, int blockSize)
+	{
+		const int numChannels = signal.getNumChannels();
+		std::vector<TSTone<float>> tone((size_t)numChannels);
+		std::vector<IIRFilter> highPass((size_t)numChannels);
+		for (int channel = 0; channel < numChannels; channel++)
+		{
+			tone[(size_t)channel].setSampleRate((float)fs);
+			tone[(size_t)channel].setTone(0.7f);
+			highPass[(size_t)channel].setCoefficients(IIRCoefficients::makeHighPass(fs, 3.0));
+		}
+
+		SmoothedValue<float> level;
+		level.reset(fs, 0.01);
+		level.setCurrentAndTargetValue(0.5f);
+
+		const auto start = Time::getHighResolutionTicks();
+		for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+		{
+			const int n = jmin(blockSize, signal.getNumSamples() - pos);
+			AudioBuffer<float> block(signal.getArrayOfWritePointers(), numChannels, pos, n);
+			level.applyGain(block, n);
+
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				float* channelData = block.getWritePointer(channel);
+				tone[(size_t)channel].processBlock(channelData, n);
+				highPass[(size_t)channel].processSamples(channelData, n);
+			}
+		}
+
+		return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+	}
+
+	/*The same chain in a single pass per channel*/
+	inline double runFused(AudioBuffer<float>& signal, double fs, int blockSize)
+	{
+		const int numChannels = signal.getNumChannels();
+		TSPostStage<float> postStage;
+		postStage.setTone(0.7f);
+		postStage.prepare((float)fs, blockSize, numChannels);
+
+		SmoothedValue<float> level, tone;
+		level.reset(fs, 0.01);
+		level.setCurrentAndTargetValue(0.5f);
+		tone.reset(fs, 0.01);
+		tone.setCurrentAndTargetValue(0.7f);
+
+		std::vector<float*> channels((size_t)numChannels);
+		const auto start = Time::getHighResolutionTicks();
+		for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+		{
+			const int n = jmin(blockSize, signal.getNumSamples() - pos);
+			for (int channel = 0; channel < numChannels; channel++)
+				channels[(size_t)channel] = signal.getWritePointer(channel, pos);
+
+			postStage.process(channels.data(), numChannels, n, level, tone);
+		}
+
+		return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+	}
+
+	/*
+	Times both versions at each block size, up to blocks far larger than the
+	cache, and checks they produce the same output.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double fs = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 10.0;
+		const int numChannels = args.containsOption("--channels") ? args.getValueForOption("--channels").getIntValue() : 2;
+		const auto blockSizes = BenchmarkUtils::parseList<int>(args.getValueForOption("--blocks"), { 512, 4096, 32768, 262144 });
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("block_size,channels,separate_ns_per_sample,fused_ns_per_sample,speedup,max_abs_diff");
+
+		const auto input = BenchmarkUtils::makeTestSignal(args.getValueForOption("--input"), fs, numChannels, seconds);
+		const double numSamples = (double)input.getNumSamples() * numChannels;
+
+		for (int blockSize : blockSizes)
+		{
+			AudioBuffer<float> separate(input), fused(input);
+			const double separateSeconds = runSeparate(separate, fs, blockSize);
+			const double fusedSeconds = runFused(fused, fs, blockSize);
+
+			float maxDiff = 0.0f;
+			for (int channel = 0; channel < numChannels; channel++)
+				for (int i = 0; i < input.getNumSamples(); i++)
+					maxDiff = jmax(maxDiff, std::abs(separate.getSample(channel, i) - fused.getSample(channel, i)));
+
+			csv.writeLine(StringArray{ String(blockSize), String(numChannels), String(1.0e9 * separateSeconds / numSamples, 3),
+				String(1.0e9 * fusedSeconds / numSamples, 3), String(separateSeconds / fusedSeconds, 3), String(maxDiff) }.joinIntoString(","));
+		}
+	}
+
+	/*Magnitude response in dB of normalised biquad coefficients at w radians per sample*/
+	inline double magnitudeDb(const double* c, double w)
+	{
+		const std::complex<double> z = std::polar(1.0, -w);
+		return Decibels::gainToDecibels(std::abs((c[0] + z * (c[1] + z * c[2])) / (1.0 + z * (c[3] + z * c[4]))), -300.0);
+	}
+
+	/*
+	Times a tone update through TSTone::setTone, which runs the bilinear
+	transform and sets the IIRFilter coefficients, against a TSToneTable
+	look-up. Also finds the largest magnitude response error of the table over
+	the knob range, 20 Hz - 20 kHz.
+	*/
+	inline void toneUpdates(const ArgumentList& args)
+	{
+		const auto rates = BenchmarkUtils::parseList<double>(args.getValueForOption("--rates"), { 44100.0, 48000.0, 96000.0, 192000.0 });
+		const auto segments = BenchmarkUtils::parseList<int>(args.getValueForOption("--segments"), { 64, 128, 256, 512 });
+		const int numUpdates = 1000000;
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("sample_rate,segments,set_tone_ns,table_ns,speedup,max_response_error_db");
+
+		for (auto fs : rates)
+			for (int numSegments : segments)
+			{
+				TSTone<float> tone;
+				tone.setSampleRate((float)fs);
+				TSToneTable<float> table;
+				table.build((float)fs, numSegments);
+
+				volatile float sink = 0.0f;
+				float coefficients[5];
+				auto start = Time::getHighResolutionTicks();
+				for (int i = 0; i < numUpdates; i++)
+				{
+					tone.setTone((float)i / numUpdates);
+					tone.getCoefficients(coefficients);
+					sink = sink + coefficients[0];
+				}
+				const double toneSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+				start = Time::getHighResolutionTicks();
+				for (int i = 0; i < numUpdates; i++)
+				{
+					table.getCoefficients((float)i / numUpdates, coefficients);
+					sink = sink + coefficients[0];
+				}
+				const double tableSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+				// Response error in double, so only the interpolation is measured
+				TSTone<double> exact;
+				exact.setSampleRate(fs);
+				TSToneTable<double> exactTable;
+				exactTable.build(fs, numSegments);
+				double maxError = 0.0;
+
+				for (int i = 0; i <= 10000; i++)
+				{
+					double viaTable[5], direct[5];
+					exactTable.getCoefficients(i / 10000.0, viaTable);
+					exact.calculateCoefficients(i / 10000.0);
+					exact.getCoefficients(direct);
+
+					for (double f = 20.0; f < 20000.0; f *= 1.05)
+					{
+						const double w = MathConstants<double>::twoPi * f / fs;
+						maxError = jmax(maxError, std::abs(magnitudeDb(viaTable, w) - magnitudeDb(direct, w)));
+					}
+				}
+
+				csv.writeLine(StringArray{ String(fs), String(numSegments), String(1.0e9 * toneSeconds / numUpdates, 2),
+					String(1.0e9 * tableSeconds / numUpdates, 2), String(toneSeconds / tableSeconds, 2),
+					String(maxError, 5) }.joinIntoString(","));
+			}
+	}
+}
+
+#endif // !PostStageBenchmark_h
@@ -0,0 +1,136 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef PrecisionBenchmark_h
+#define PrecisionBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+
+/*
+Error and speed of reduced-precision TSClippingStage configurations
+against the all-double stage.
+*/
+namespace PrecisionBenchmark
+{
+	/*Output of one configuration over a whole test signal*/
+	struct Run
+	{
+		AudioBuffer<double> output;
+		double seconds = 0.0;
+		size_t tableBytes = 0;
+	};
+
+	/*Processes a signal through one stage configuration, set up as the processor does*/
+	template <class temp, class tableTemp, template<class> class Clipping>
+	Run run(int mode, double fs, double distortion, const AudioBuffer<float>& signal, int blockSize)
+	{
+		using Stage = TSClippingStage<temp, Clipping, 3, tableTemp>;
+		const auto processMode = (typename Stage::ProcessMode)mode;
+		const int numChannels = signal.getNumChannels();
+		const int numSamples = signal.getNumSamples();
+
+		Stage stage;
+		if (processMode == Stage::ProcessMode::newton)
+			stage.setSampleRate((temp)fs);
+		else
+			stage.makeLookUpTable(4096, (temp)(processMode == Stage::ProcessMode::antiAliased ? fs / 1.5 : fs), 50.0);
+
+		stage.setDistortion((temp)distortion);
+		stage.setNumChannels(numChannels);
+		stage.setProcessMode(processMode);
+
+		AudioBuffer<temp> buffer(numChannels, numSamples);
+		for (int ch = 0; ch < numChannels; ch++)
+			for (int i = 0; i < numSamples; i++)
+				buffer.setSample(ch, i, (temp)signal.getSample(ch, i));
+
+		std::vector<temp*> channels((size_t)numChannels);
+		const auto start = Time::getHighResolutionTicks();
+
+		for (int pos = 0; pos < numSamples; pos += blockSize)
+		{
+			for (int ch = 0; ch < numChannels; ch++)
+				channels[ch] = buffer.getWritePointer(ch, pos);
+
+			stage.processBlock(channels.data(), channels.data(), numChannels, jmin(blockSize, numSamples - pos));
+		}
+
+		Run result;
+		result.seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+		result.tableBytes = stage.getLookUpTableBytes();
+		result.output.makeCopyOf(buffer);
+		return result;
+	}
+
+	/*Writes the error of a run against the reference as a CSV row*/
+	inline void report(BenchmarkUtils::CsvWriter& csv, const String& prefix, const String& config, const Run& test, const Run& reference)
+	{
+		double maxError = 0.0, errorEnergy = 0.0, signalEnergy = 0.0;
+		for (int ch = 0; ch < reference.output.getNumChannels(); ch++)
+			for (int i = 0; i < reference.output.getNumSamples(); i++)
+			{
+				const double ref = reference.output.getSample(ch, i);
+				const double error = test.output.getSample(ch, i) - ref;
+				maxError = jmax(maxError, std::abs(error));
+				errorEnergy += error * error;
+				signalEnergy += ref * ref;
+			}
+
+		const double errorDb = errorEnergy > 0.0 ? 10.0 * std::log10(errorEnergy / signalEnergy) : -999.0;
+		const double numSamples = (double)reference.output.getNumSamples() * reference.output.getNumChannels();
+
+		csv.writeLine(prefix + "," + config + "," + String((int64)test.tableBytes) + "," + String(maxError)
+			+ "," + String(errorDb, 1) + "," + String(numSamples / test.seconds * 1.0e-6, 3));
+	}
+
+	/*Runs every configuration of one clipping type against the double reference*/
+	template <template<class> class Clipping>
+	void runClipping(BenchmarkUtils::CsvWriter& csv, int clipType, double fs, int blockSize, const StringArray& sources,
+		int numChannels, double seconds)
+	{
+		const char* modeNames[] = { "newton", "lookUp", "antiAliased" };
+
+		for (auto& source : sources)
+		{
+			// 0.95 peak, as the processor drives the stage
+			auto signal = BenchmarkUtils::makeTestSignal(source, fs, numChannels, seconds);
+			signal.applyGain(1.9f);
+
+			for (int mode = 0; mode < 3; mode++)
+				for (double distortion : { 0.0, 0.5, 1.0 })
+				{
+					const String prefix = String(clipType) + "," + modeNames[mode] + "," + String(distortion, 2) + "," + source;
+
+					const auto reference = run<double, double, Clipping>(mode, fs, distortion, signal, blockSize);
+					report(csv, prefix, "double", reference, reference);
+					report(csv, prefix, "double_state_float_table", run<double, float, Clipping>(mode, fs, distortion, signal, blockSize), reference);
+					report(csv, prefix, "float", run<float, float, Clipping>(mode, fs, distortion, signal, blockSize), reference);
+				}
+		}
+	}
+
+	/*
+	Compares double, double-state/float-table and float stages in every mode,
+	at three distortion settings, at the 2x oversampled rate of a 48 kHz stream.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double fs = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 96000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 1.0;
+		const int numChannels = args.containsOption("--channels") ? args.getValueForOption("--channels").getIntValue() : 2;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 1024;
+		const StringArray sources = StringArray::fromTokens(args.containsOption("--input") ? args.getValueForOption("--input") : "sine,noise", ",", {});
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("clip_type,mode,distortion,signal,config,table_bytes,max_abs_error,error_db,msamples_per_s");
+		runClipping<SymmetricClipping>(csv, 0, fs, blockSize, sources, numChannels, seconds);
+		runClipping<AsymmetricClipping>(csv, 1, fs, blockSize, sources, numChannels, seconds);
+	}
+}
+
+#endif // !PrecisionBenchmark_h
@@ -0,0 +1,345 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef ProcessorBenchmark_h
+#define ProcessorBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/PluginProcessor.h"
+
+/*
+Offline rendering and realtime-factor measurement of the complete
+TubeScreamerAudioProcessor chain, without a host or editor.
+*/
+namespace ProcessorBenchmark
+{
+	/*Pedal settings applied before prepareToPlay*/
+	struct Settings
+	{
+		float distortion = 0.5f;
+		float tone = 0.5f;
+		float level = 0.5f;
+		bool aa = true;
+		int clipType = 1;
+		int oversampling = 2;	// 1, 2, 4, 8 or 16
+		int osFilter = 0;		// 0: linear phase FIR, 1: polyphase IIR
+	};
+
+	/*Timing of one (settings, sample rate, block size) run*/
+	struct Result
+	{
+		double realtimeFactor = 0.0;
+		double blockP50 = 0.0;	// per-block latency percentiles in microseconds
+		double blockP95 = 0.0;
+		double blockP99 = 0.0;
+		double blockMax = 0.0;
+		double cyclesPerSample = 0.0;
+	};
+
+	/*Sets a parameter from its real (not normalised) value*/
+	inline void setParameter(TubeScreamerAudioProcessor& processor, const String& id, float value)
+	{
+		if (auto* param = processor.getAPVTS().getParameter(id))
+			param->setValueNotifyingHost(param->convertTo0to1(value));
+	}
+
+	/*
+	Creates a processor with the given settings, ready to play. Offline, wide
+	buses are processed on the worker pool.
+	*/
+	inline std::unique_ptr<TubeScreamerAudioProcessor> makeProcessor(const Settings& settings, int numChannels, double sampleRate, int blockSize,
+		bool nonRealtime = true)
+	{
+		auto processor = std::make_unique<TubeScreamerAudioProcessor>();
+		setParameter(*processor, "dist", settings.distortion);
+		setParameter(*processor, "tone", settings.tone);
+		setParameter(*processor, "output", settings.level);
+		setParameter(*processor, "aa", settings.aa ? 1.0f : 0.0f);
+		setParameter(*processor, "clip_type", (float)settings.clipType);
+		setParameter(*processor, "os_factor", (float)roundToInt(std::log2(settings.oversampling)));
+		setParameter(*processor, "os_filter", (float)settings.osFilter);
+
+		processor->isOn = true;
+		processor->setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+		processor->setNonRealtime(nonRealtime);
+		processor->prepareToPlay(sampleRate, blockSize);
+		return processor;
+	}
+
+	/*Processes the signal in place, block by block, timing each call to processBlock*/
+	inline Result run(TubeScreamerAudioProcessor& processor, AudioBuffer<float>& signal, double sampleRate, int blockSize)
+	{
+		const int numChannels = signal.getNumChannels();
+		const int numSamples = signal.getNumSamples();
+		AudioBuffer<float> block(numChannels, blockSize);
+		MidiBuffer midi;
+		std::vector<double> blockTimes;
+		blockTimes.reserve((size_t)(numSamples / blockSize + 1));
+
+		int64 totalTicks = 0;
+		uint64 totalCycles = 0;
+
+		for (int pos = 0; pos < numSamples; pos += blockSize)
+		{
+			const int n = jmin(blockSize, numSamples - pos);
+			block.setSize(numChannels, n, false, false, true);
+			for (int ch = 0; ch < numChannels; ch++)
+				block.copyFrom(ch, 0, signal, ch, pos, n);
+
+			const auto cycles0 = BenchmarkUtils::readCycleCounter();
+			const auto ticks0 = Time::getHighResolutionTicks();
+			processor.processBlock(block, midi);
+			const auto ticks1 = Time::getHighResolutionTicks();
+			const auto cycles1 = BenchmarkUtils::readCycleCounter();
+
+			totalTicks += ticks1 - ticks0;
+			totalCycles += cycles1 - cycles0;
+			blockTimes.push_back(1.0e6 * Time::highResolutionTicksToSeconds(ticks1 - ticks0));
+
+			for (int ch = 0; ch < numChannels; ch++)
+				signal.copyFrom(ch, pos, block, ch, 0, n);
+		}
+
+		Result result;
+		const double seconds = Time::highResolutionTicksToSeconds(totalTicks);
+		result.realtimeFactor = seconds > 0.0 ? (numSamples / sampleRate) / seconds : 0.0;
+		result.blockP50 = BenchmarkUtils::percentile(blockTimes, 0.50);
+		result.blockP95 = BenchmarkUtils::percentile(blockTimes, 0.95);
+		result.blockP99 = BenchmarkUtils::percentile(blockTimes, 0.99);
+		result.blockMax = BenchmarkUtils::percentile(blockTimes, 1.0);
+		result.cyclesPerSample = (double)totalCycles / (double)numSamples;
+		return result;
+	}
+
+	/*
+	Renders an input (file, "sine" or "noise") through the processor to a 24-bit WAV file.
+	*/
+	inline void render(const ArgumentList& args)
+	{
+		args.checkMinNumArguments(3);
+		const String source = args[1].text;
+		const File outputFile = args[2].resolveAsFile();
+
+		Settings settings;
+		settings.distortion = args.containsOption("--dist") ? args.getValueForOption("--dist").getFloatValue() : 0.5f;
+		settings.tone = args.containsOption("--tone") ? args.getValueForOption("--tone").getFloatValue() : 0.5f;
+		settings.level = args.containsOption("--level") ? args.getValueForOption("--level").getFloatValue() : 0.5f;
+		settings.aa = args.containsOption("--aa") ? args.getValueForOption("--aa").getIntValue() != 0 : true;
+		settings.clipType = args.containsOption("--clip") ? args.getValueForOption("--clip").getIntValue() : 1;
+		settings.oversampling = args.containsOption("--os") ? args.getValueForOption("--os").getIntValue() : 2;
+		settings.osFilter = args.containsOption("--os-filter") ? args.getValueForOption("--os-filter").getIntValue() : 0;
+
+		const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 5.0;
+
+		double fileRate = sampleRate;
+		double fileSeconds = seconds;
+		int numChannels = 2;
+		if (source != "sine" && source != "noise")
+		{
+			AudioFormatManager formatManager;
+			formatManager.registerBasicFormats();
+			std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(args[1].resolveAsFile()));
+
+			if (reader == nullptr)
+				ConsoleApplication::fail("Could not read audio file: " + source);
+
+			fileRate = reader->sampleRate;
+			fileSeconds = (double)reader->lengthInSamples / reader->sampleRate;
+			numChannels = jmax(2, (int)reader->numChannels);
+		}
+
+		if (args.containsOption("--channels"))
+			numChannels = jmax(1, args.getValueForOption("--channels").getIntValue());
+
+		auto signal = BenchmarkUtils::makeTestSignal(source == "sine" || source == "noise" ? source : args[1].resolveAsFile().getFullPathName(),
+			fileRate, numChannels, fileSeconds);
+		auto processor = makeProcessor(settings, signal.getNumChannels(), fileRate, blockSize);
+		const auto result = run(*processor, signal, fileRate, blockSize);
+
+		outputFile.deleteFile();
+		WavAudioFormat wav;
+		std::unique_ptr<AudioFormatWriter> writer(wav.createWriterFor(outputFile.createOutputStream().release(),
+			fileRate, (unsigned int)signal.getNumChannels(), 24, {}, 0));
+
+		if (writer == nullptr)
+			ConsoleApplication::fail("Could not write: " + outputFile.getFullPathName());
+
+		writer->writeFromAudioSampleBuffer(signal, 0, signal.getNumSamples());
+
+		std::cout << "Rendered " << outputFile.getFullPathName() << " at " << result.realtimeFactor << "x realtime, "
+			<< processor->getLatencySamples() << " samples latency" << std::endl;
+	}
+
+	/*
+	Runs every (aa, clip_type, sample rate, block size) combination and writes one CSV row for each.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const auto rates = BenchmarkUtils::parseList<double>(args.getValueForOption("--rates"),
+			{ 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 });
+		const auto blockSizes = BenchmarkUtils::parseList<int>(args.getValueForOption("--blocks"),
+			{ 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 });
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 2.0;
+		const String source = args.containsOption("--input") ? args.getValueForOption("--input") : String("sine");
+		const String label = args.containsOption("--label") ? args.getValueForOption("--label") : String("dev");
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("label,aa,clip_type,sample_rate,block_size,seconds,realtime_factor,"
+			"block_p50_us,block_p95_us,block_p99_us,block_max_us,cycles_per_sample");
+
+		for (int aa = 0; aa < 2; aa++)
+			for (int clipType = 0; clipType < 2; clipType++)
+				for (auto sampleRate : rates)
+					for (auto blockSize : blockSizes)
+					{
+						Settings settings;
+						settings.aa = aa != 0;
+						settings.clipType = clipType;
+
+						auto processor = makeProcessor(settings, 2, sampleRate, blockSize);
+
+						// warm up caches and smoothers before timing
+						auto warmUp = BenchmarkUtils::makeTestSignal(source, sampleRate, 2, 0.1);
+						run(*processor, warmUp, sampleRate, blockSize);
+
+						auto signal = BenchmarkUtils::makeTestSignal(source, sampleRate, 2, seconds);
+						const auto result = run(*processor, signal, sampleRate, blockSize);
+
+						csv.writeLine(StringArray{ label, String(aa), String(clipType), String(sampleRate), String(blockSize),
+							String(seconds), String(result.realtimeFactor, 3), String(result.blockP50, 3), String(result.blockP95, 3),
+							String(result.blockP99, 3), String(result.blockMax, 3), String(result.cyclesPerSample, 2) }.joinIntoString(","));
+					}
+	}
+
+	/*
+	Times every block while aa and clip_type cycle through their four
+	combinations, and compares the blocks of a switch (the new stage warming
+	up, then the crossfade) with the blocks between switches.
+	*/
+	inline void switching(const ArgumentList& args)
+	{
+		const auto factors = BenchmarkUtils::parseList<int>(args.getValueForOption("--factors"), { 1, 2, 4, 8 });
+		const auto blockSizes = BenchmarkUtils::parseList<int>(args.getValueForOption("--blocks"), { 64, 256, 1024 });
+		const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 2.0;
+		const String source = args.containsOption("--input") ? args.getValueForOption("--input") : String("sine");
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("oversampling,block_size,switches,steady_p50_us,steady_max_us,switch_p50_us,switch_max_us,switch_over_steady_max");
+
+		const int switchLength = roundToInt((TSClippingEngine::warmUpTime + TSClippingEngine::crossfadeTime) * sampleRate);
+
+		for (int factor : factors)
+			for (int blockSize : blockSizes)
+			{
+				Settings settings;
+				settings.oversampling = factor;
+
+				// Prepared offline so the tables are built before timing, then played live
+				auto processor = makeProcessor(settings, 2, sampleRate, blockSize);
+				processor->setNonRealtime(false);
+
+				// warm up caches and smoothers before timing
+				auto warmUp = BenchmarkUtils::makeTestSignal(source, sampleRate, 2, 0.1);
+				run(*processor, warmUp, sampleRate, blockSize);
+
+				// Switches far enough apart that the blocks between them are steady
+				auto signal = BenchmarkUtils::makeTestSignal(source, sampleRate, 2, seconds);
+				const int interval = 4 * jmax(switchLength, blockSize);
+				AudioBuffer<float> block(2, blockSize);
+				MidiBuffer midi;
+				std::vector<double> steadyTimes, switchTimes;
+				int mode = (settings.aa ? 2 : 0) + settings.clipType;
+				int sinceSwitch = interval;
+				int numSwitches = 0;
+
+				for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+				{
+					if (sinceSwitch >= interval)
+					{
+						mode = (mode + 1) % 4;
+						setParameter(*processor, "aa", (float)(mode / 2));
+						setParameter(*processor, "clip_type", (float)(mode % 2));
+						sinceSwitch = 0;
+						numSwitches++;
+					}
+
+					const int n = jmin(blockSize, signal.getNumSamples() - pos);
+					block.setSize(2, n, false, false, true);
+					for (int ch = 0; ch < 2; ch++)
+						block.copyFrom(ch, 0, signal, ch, pos, n);
+
+					const auto ticks0 = Time::getHighResolutionTicks();
+					processor->processBlock(block, midi);
+					const double us = 1.0e6 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - ticks0);
+
+					(sinceSwitch < switchLength ? switchTimes : steadyTimes).push_back(us);
+					sinceSwitch += n;
+				}
+
+				const double steadyMax = BenchmarkUtils::percentile(steadyTimes, 1.0);
+				const double switchMax = BenchmarkUtils::percentile(switchTimes, 1.0);
+				csv.writeLine(StringArray{ String(factor), String(blockSize), String(numSwitches),
+					String(BenchmarkUtils::percentile(steadyTimes, 0.5), 3), String(steadyMax, 3),
+					String(BenchmarkUtils::percentile(switchTimes, 0.5), 3), String(switchMax, 3),
+					String(steadyMax > 0.0 ? switchMax / steadyMax : 0.0, 3) }.joinIntoString(","));
+			}
+	}
+
+	/*
+	Renders buses of each width live (channel groups one after another) and
+	offline (channel groups spread over the worker pool).
+	*/
+	inline void channels(const ArgumentList& args)
+	{
+		const auto widths = BenchmarkUtils::parseList<int>(args.getValueForOption("--channels"), { 1, 2, 6, 8, 12, 16 });
+		const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 2.0;
+		const String source = args.containsOption("--input") ? args.getValueForOption("--input") : String("sine");
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("channels,groups,workers,live_realtime_factor,offline_realtime_factor,speedup,max_abs_diff");
+
+		const int numWorkers = SharedResourcePointer<TSWorkerPool>()->getNumWorkers();
+
+		for (int numChannels : widths)
+		{
+			Result results[2];
+			AudioBuffer<float> outputs[2];
+
+			for (int offline = 0; offline < 2; offline++)
+			{
+				// Both are prepared offline, so their tables are built before timing
+				// starts and both runs use them; the live run then processes its
+				// groups in turn on this thread
+				auto processor = makeProcessor(Settings(), numChannels, sampleRate, blockSize);
+				processor->setNonRealtime(offline != 0);
+
+				// warm up caches and smoothers before timing
+				auto warmUp = BenchmarkUtils::makeTestSignal(source, sampleRate, numChannels, 0.1);
+				run(*processor, warmUp, sampleRate, blockSize);
+
+				outputs[offline] = BenchmarkUtils::makeTestSignal(source, sampleRate, numChannels, seconds);
+				results[offline] = run(*processor, outputs[offline], sampleRate, blockSize);
+			}
+
+			float maxDiff = 0.0f;
+			for (int ch = 0; ch < numChannels; ch++)
+				for (int i = 0; i < outputs[0].getNumSamples(); i++)
+					maxDiff = jmax(maxDiff, std::abs(outputs[0].getSample(ch, i) - outputs[1].getSample(ch, i)));
+
+			csv.writeLine(StringArray{ String(numChannels), String(TSChannelGroups::getNumGroups(numChannels)), String(numWorkers),
+				String(results[0].realtimeFactor, 3), String(results[1].realtimeFactor, 3),
+				String(results[1].realtimeFactor / results[0].realtimeFactor, 3), String(maxDiff) }.joinIntoString(","));
+		}
+	}
+}
+
+#endif // !ProcessorBenchmark_h
@@ -0,0 +1,174 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef SolverBenchmark_h
+#define SolverBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+
+/*
+Accuracy and speed of the clipping stage solvers in the newton mode.
+*/
+namespace SolverBenchmark
+{
+	/*Output of one solver over a whole test signal*/
+	struct Run
+	{
+		std::vector<double> output;
+		double seconds = 0.0;
+	};
+
+	/*Processes a signal through a newton mode stage with the given solver*/
+	template <template<class> class Clipping>
+	Run run(int solver, double fs, double distortion, const AudioBuffer<float>& signal, int blockSize)
+	{
+		using Stage = TSClippingStage<double, Clipping>;
+
+		Stage stage;
+		stage.setSampleRate(fs);
+		stage.setDistortion(distortion);
+		stage.setProcessMode(Stage::ProcessMode::newton);
+		stage.setSolver((typename Stage::Solver)solver);
+
+		Run result;
+		result.output.resize((size_t)signal.getNumSamples());
+		for (size_t i = 0; i < result.output.size(); i++)
+			result.output[i] = signal.getSample(0, (int)i);
+
+		const auto start = Time::getHighResolutionTicks();
+		for (int pos = 0; pos < signal.getNumSamples(); pos += blockSize)
+		{
+			double* block = result.output.data() + pos;
+			stage.processBlock(block, block, jmin(blockSize, signal.getNumSamples() - pos));
+		}
+
+		result.seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+		return result;
+	}
+
+	/*Runs every solver of one clipping type against capped Newton*/
+	template <template<class> class Clipping>
+	void runClipping(BenchmarkUtils::CsvWriter& csv, int clipType, double fs, int blockSize, const StringArray& sources, double seconds)
+	{
+		const char* solverNames[] = { "capped_newton", "damped_newton", "wright_omega" };
+
+		for (auto& source : sources)
+		{
+			// 0.95 peak, as the processor drives the stage
+			auto signal = BenchmarkUtils::makeTestSignal(source, fs, 1, seconds);
+			signal.applyGain(1.9f);
+
+			for (double distortion : { 0.0, 0.5, 1.0 })
+			{
+				const auto reference = run<Clipping>(0, fs, distortion, signal, blockSize);
+
+				for (int solver = 0; solver < 3; solver++)
+				{
+					const auto test = solver == 0 ? reference : run<Clipping>(solver, fs, distortion, signal, blockSize);
+
+					double maxError = 0.0;
+					for (size_t i = 0; i < test.output.size(); i++)
+						maxError = jmax(maxError, std::abs(test.output[i] - reference.output[i]));
+
+					const double numSamples = (double)test.output.size();
+					csv.writeLine(StringArray{ String(clipType), String(distortion, 2), source, solverNames[solver],
+						String(maxError), String(numSamples / test.seconds * 1.0e-6, 3),
+						String(reference.seconds / test.seconds, 3) }.joinIntoString(","));
+				}
+			}
+		}
+	}
+
+	/*
+	Compares capped Newton, damped Newton and the explicit Wright omega solver
+	at the 2x oversampled rate of a 48 kHz stream.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const double fs = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 96000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 1.0;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 1024;
+		const StringArray sources = StringArray::fromTokens(args.containsOption("--input") ? args.getValueForOption("--input") : "sine,noise", ",", {});
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("clip_type,distortion,signal,solver,max_abs_error,msamples_per_s,speedup");
+		runClipping<SymmetricClipping>(csv, 0, fs, blockSize, sources, seconds);
+		runClipping<AsymmetricClipping>(csv, 1, fs, blockSize, sources, seconds);
+	}
+
+	/*Writes the solver counts and block times of one (solver, distortion, level) run as a CSV row*/
+	template <template<class> class Clipping>
+	void runStats(BenchmarkUtils::CsvWriter& csv, int clipType, int solver, double fs, double distortion, double level,
+		const AudioBuffer<float>& signal, int blockSize)
+	{
+		using Stage = TSClippingStage<double, Clipping>;
+		const char* solverNames[] = { "capped_newton", "damped_newton", "wright_omega" };
+
+		Stage stage;
+		stage.setSampleRate(fs);
+		stage.setDistortion(distortion);
+		stage.setProcessMode(Stage::ProcessMode::newton);
+		stage.setSolver((typename Stage::Solver)solver);
+
+		std::vector<double> block((size_t)blockSize);
+		std::vector<double> blockTimes;
+		TSSolverStats stats;
+
+		for (int pos = 0; pos + blockSize <= signal.getNumSamples(); pos += blockSize)
+		{
+			for (int i = 0; i < blockSize; i++)
+				block[(size_t)i] = level * signal.getSample(0, pos + i);
+
+			const auto start = Time::getHighResolutionTicks();
+			stage.processBlock(block.data(), block.data(), blockSize);
+			blockTimes.push_back(1.0e6 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start));
+			stats.addBlock(stage.getBlockSolverCounts());
+		}
+
+		const auto counts = stats.get();
+		const double solves = (double)jmax((uint64)1, counts.total.solves);
+		csv.writeLine(StringArray{ String(clipType), solverNames[solver], String(distortion, 2), String(level, 2),
+			String((int64)counts.numBlocks), String((double)counts.total.iterations / solves, 3), String((int64)counts.total.maxIterations),
+			String((double)counts.total.subIterations / solves, 3), String((double)counts.total.capHits / solves, 3),
+			String((int64)counts.total.nonConverged), String((int64)counts.worstBlock.iterations),
+			String(BenchmarkUtils::percentile(blockTimes, 0.99), 3), String(BenchmarkUtils::percentile(blockTimes, 1.0), 3) }.joinIntoString(","));
+	}
+
+	/*
+	Dumps the solver counts of newton mode stages over a grid of Drive
+	settings and input levels, with block time percentiles, so CPU spikes can
+	be traced to the settings and solver that cause them.
+	*/
+	inline void stats(const ArgumentList& args)
+	{
+		const double fs = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 96000.0;
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 1.0;
+		const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 1024;
+		const String source = args.containsOption("--input") ? args.getValueForOption("--input") : String("sine");
+		const auto distortions = BenchmarkUtils::parseList<double>(args.getValueForOption("--dists"), { 0.0, 0.25, 0.5, 0.75, 1.0 });
+		const auto levels = BenchmarkUtils::parseList<double>(args.getValueForOption("--levels"), { 0.1, 0.5, 1.0, 2.0 });
+
+		// 0.95 peak at level 1, as the processor drives the stage
+		auto signal = BenchmarkUtils::makeTestSignal(source, fs, 1, seconds);
+		signal.applyGain(1.9f);
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("clip_type,solver,distortion,level,blocks,iterations_per_solve,max_iterations,sub_iterations_per_solve,"
+			"cap_hits_per_solve,non_converged,worst_block_iterations,block_p99_us,block_max_us");
+
+		for (int solver = 0; solver < 3; solver++)
+			for (auto distortion : distortions)
+				for (auto level : levels)
+				{
+					runStats<SymmetricClipping>(csv, 0, solver, fs, distortion, level, signal, blockSize);
+					runStats<AsymmetricClipping>(csv, 1, solver, fs, distortion, level, signal, blockSize);
+				}
+	}
+}
+
+#endif // !SolverBenchmark_h
@@ -0,0 +1,100 @@
+/*-----------------------------------------------------------------------
+ ALIASING REDUCTION IN VIRTUAL ANALOGUE MODELLING
+ Alistair Carson 2020
+ MSc Acoustics & Music Technology
+ University of Edinburgh
+--------------------------------------------------------------------*/
+
+#pragma once
+#ifndef TableBenchmark_h
+#define TableBenchmark_h
+#include "BenchmarkUtils.h"
+#include "../../TubeScreamer/Source/TSClippingStage.h"
+
+/*
+Size, accuracy and build time of error-bounded clipping tables against the
+uniform 4096 point table.
+*/
+namespace TableBenchmark
+{
+	/*Builds one table and writes its size, error and speed as a CSV row*/
+	template <template<class> class Clipping>
+	void run(BenchmarkUtils::CsvWriter& csv, int clipType, double fs, double maxError, const AudioBuffer<float>& signal)
+	{
+		using Stage = TSClippingStage<double, Clipping>;
+		Stage table;
+
+		auto start = Time::getHighResolutionTicks();
+		if (maxError > 0.0)
+			table.makeBoundedLookUpTable(fs, maxError);
+		else
+			table.makeLookUpTable(4096, fs, 50.0);
+		const double buildSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+		// Output error against the Newton solver, including interpolation across distortion
+		double outputError = 0.0, lookUpSeconds = 0.0;
+
+		for (double distortion : { 0.0, 0.3, 0.7, 1.0 })
+		{
+			Stage newton;
+			newton.setSampleRate(fs);
+			newton.setDistortion(distortion);
+			newton.setProcessMode(Stage::ProcessMode::newton);
+
+			table.reset();
+			table.setDistortion(distortion);
+			table.setProcessMode(Stage::ProcessMode::lookUp);
+
+			std::vector<double> in((size_t)signal.getNumSamples()), viaTable(in.size()), viaNewton(in.size());
+			for (size_t i = 0; i < in.size(); i++)
+				in[i] = signal.getSample(0, (int)i);
+
+			start = Time::getHighResolutionTicks();
+			table.processBlock(in.data(), viaTable.data(), (int)in.size());
+			lookUpSeconds += Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+			newton.processBlock(in.data(), viaNewton.data(), (int)in.size());
+			for (size_t i = 0; i < in.size(); i++)
+				outputError = jmax(outputError, std::abs(viaTable[i] - viaNewton[i]));
+		}
+
+		const double numSamples = 4.0 * signal.getNumSamples();
+		csv.writeLine(StringArray{ String(clipType), String(fs), String(maxError), String(table.getLookUpTableRange()),
+			String((int64)table.getLookUpTableBytes()), String(table.getLookUpTableError()), String(outputError),
+			String(1.0e3 * buildSeconds, 1), String(numSamples / lookUpSeconds * 1.0e-6, 3) }.joinIntoString(","));
+	}
+
+	/*
+	Builds uniform (--errors=0) and error-bounded tables for both clipping
+	types at each rate, bypassing the on-disk cache so build times are real.
+	*/
+	inline void benchmark(const ArgumentList& args)
+	{
+		const auto rates = BenchmarkUtils::parseList<double>(args.getValueForOption("--rates"), { 88200.0, 96000.0, 192000.0 });
+		const auto errors = BenchmarkUtils::parseList<double>(args.getValueForOption("--errors"), { 0.0, 1.0e-4, 1.0e-5, 1.0e-6 });
+		const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 0.5;
+
+		const File cache = File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("TSTableBenchmark", "");
+		TSTableCache::setDirectory(cache);
+
+		BenchmarkUtils::CsvWriter csv(args.getValueForOption("--csv"));
+		csv.writeLine("clip_type,sample_rate,target_error,p_range,table_bytes,measured_error,output_error,build_ms,lookup_msamples_per_s");
+
+		for (auto fs : rates)
+		{
+			// 0.95 peak, as the processor drives the stage
+			auto signal = BenchmarkUtils::makeTestSignal(args.getValueForOption("--input"), fs, 1, seconds);
+			signal.applyGain(1.9f);
+
+			for (auto maxError : errors)
+			{
+				run<SymmetricClipping>(csv, 0, fs, maxError, signal);
+				run<AsymmetricClipping>(csv, 1, fs, maxError, signal);
+			}
+		}
+
+		cache.deleteRecursively();
+	}
+}
+
+#endif // !TableBenchmark_h